@@ -0,0 +1,18 @@
+#include "trims"
+
+namespace tf {
+
+// Combinators are header only and nothing parses with them yet. A table of tagged and untagged
+// alternatives is built here, so that they are compiled and instantiated with the library
+namespace {
+
+constexpr auto _literal = one_of(
+    first(scan::classes::digit, ptf::trim_num_literal),
+    first(scan::classes::ident, trim_while_in_t(scan::classes::ident)),
+    ptf::trim_string_literal);
+
+static_assert(_literal.dispatch['7'] == 0 && _literal.dispatch['_'] == 1 && _literal.dispatch[' '] == 2);
+
+}
+
+}
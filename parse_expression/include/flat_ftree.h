@@ -0,0 +1,134 @@
+#pragma once
+
+#include <ranges>
+
+#include "ftree.h"
+
+namespace ftree {
+
+// Copy of an ftree as parallel arrays in post-order: the id of each node, the first node of its subtree
+// and the span of its text. Operands come right before the nodes, that apply to them, so the subtree of i
+// is [first(i), i] and a walk in memory order meets every operand before its operator.
+// Texts of leaves are copied next to each other, the tree doesnt refer to the source
+class flat_ftree {
+public:
+    // opr::opr_id of operators, leaf_ids + leaf_type of leaves
+    using node_id = uint8_t;
+    static constexpr node_id leaf_ids = opr::oprs + 1;
+
+    struct span {
+        uint32_t offset, length;
+    };
+
+    class node_view;
+    class iterator;
+private:
+    trims::counted_vector<node_id> _ids;
+    trims::counted_vector<node_index> _first;
+    trims::counted_vector<span> _spans;
+    trims::counted_string _text;
+public:
+    flat_ftree() = default;
+    // One pass over the nodes, as they are laid out in post-order already
+    explicit flat_ftree(const ftree& tree) {
+        node_index size = tree.nodes().size();
+        _ids.reserve(size), _first.reserve(size), _spans.reserve(size);
+        for (node_index i = 0; i < size; ++i) {
+            const arena_node& node = tree[i];
+            uint32_t offset = _text.size();
+            if (node.kind == node_kind::leaf) {
+                _ids.push_back(leaf_ids + std::to_underlying(node.leaf_tp()));
+                _first.push_back(i);
+                _spans.push_back({ offset, node.length });
+                _text.append(node.expr());
+            } else {
+                _ids.push_back(opr::id_of(node.opr_tp()));
+                _first.push_back(_first[node.opds[0]]);
+                _spans.push_back({ offset, 0 });
+            }
+        }
+    }
+
+    node_index size() const noexcept { return _ids.size(); }
+    node_index root() const noexcept { return size() - 1; }
+
+    node_id id(node_index i) const noexcept { return _ids[i]; }
+    node_kind kind(node_index i) const noexcept {
+        if (_ids[i] >= leaf_ids)
+            return node_kind::leaf;
+        if (_ids[i] < opr::unary_oprs)
+            return node_kind::unary;
+        if (_ids[i] < opr::unary_oprs + opr::binary_oprs)
+            return node_kind::binary;
+        return _ids[i] == opr::id_of(opr::ternary_opr::ways) ? node_kind::ways : node_kind::condition;
+    }
+    _tree_node::leaf_type leaf_tp(node_index i) const noexcept {
+        return static_cast<_tree_node::leaf_type>(_ids[i] - leaf_ids);
+    }
+    opr::opr opr_tp(node_index i) const noexcept { return opr::opr_of(_ids[i]); }
+    std::string_view expr(node_index i) const noexcept {
+        return std::string_view(_text).substr(_spans[i].offset, _spans[i].length);
+    }
+
+    node_index first(node_index i) const noexcept { return _first[i]; }
+    node_index subtree_size(node_index i) const noexcept { return i - _first[i] + 1; }
+    // The last operand is right before the node, the one before it ends right before the subtree of the last
+    node_index opd(node_index i, size_t n) const noexcept {
+        node_index last = i - 1;
+        return n + 1 == (kind(i) == node_kind::unary ? 1 : 2) ? last : _first[last] - 1;
+    }
+
+    iterator begin() const noexcept;
+    iterator end() const noexcept;
+    auto subtree(node_index i) const noexcept;
+};
+
+// Node of a flat tree by its index, as iterators give it
+class flat_ftree::node_view {
+private:
+    const flat_ftree* _tree;
+    node_index _index;
+public:
+    node_view(const flat_ftree& tree, node_index index) noexcept : _tree(&tree), _index(index) {}
+
+    node_index index() const noexcept { return _index; }
+    node_kind kind() const noexcept { return _tree->kind(_index); }
+    _tree_node::leaf_type leaf_tp() const noexcept { return _tree->leaf_tp(_index); }
+    opr::opr opr_tp() const noexcept { return _tree->opr_tp(_index); }
+    std::string_view expr() const noexcept { return _tree->expr(_index); }
+    node_index subtree_size() const noexcept { return _tree->subtree_size(_index); }
+    node_view opd(size_t n) const noexcept { return { *_tree, _tree->opd(_index, n) }; }
+};
+
+class flat_ftree::iterator {
+private:
+    const flat_ftree* _tree = nullptr;
+    node_index _index = 0;
+public:
+    using iterator_concept = std::forward_iterator_tag;
+    using iterator_category = std::input_iterator_tag;
+    using value_type = node_view;
+    using difference_type = std::ptrdiff_t;
+
+    iterator() = default;
+    iterator(const flat_ftree& tree, node_index index) noexcept : _tree(&tree), _index(index) {}
+
+    node_view operator*() const noexcept { return { *_tree, _index }; }
+    iterator& operator++() noexcept { return ++_index, *this; }
+    iterator operator++(int) noexcept { return { *_tree, _index++ }; }
+    bool operator==(const iterator& other) const noexcept { return _index == other._index; }
+};
+
+inline flat_ftree::iterator flat_ftree::begin() const noexcept {
+    return { *this, 0 };
+}
+
+inline flat_ftree::iterator flat_ftree::end() const noexcept {
+    return { *this, size() };
+}
+
+inline auto flat_ftree::subtree(node_index i) const noexcept {
+    return std::ranges::subrange(iterator(*this, _first[i]), iterator(*this, i + 1));
+}
+
+}
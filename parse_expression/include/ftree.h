@@ -17,22 +17,22 @@ struct ftree_leaf {
     ftree_leaf(leaf_type tp, std::string_view expr) : tp(tp), expr(expr) {}
 };
 
-#define node_ptr std::unique_ptr<ftree_node>
+struct ftree_node;
+using node_ptr = std::unique_ptr<ftree_node>;
 
+// Operands are moved in, either owned already or given by value, so building a tree never copies one
 struct unary_node {
     opr::unary_opr tp;
     node_ptr opd;
     unary_node(opr::unary_opr tp, node_ptr opd) : tp(tp), opd(std::move(opd)) {}
-    unary_node(opr::unary_opr tp, ftree_node opd) : tp(tp), opd(std::make_unique<ftree_node>(opd)) {}
+    unary_node(opr::unary_opr tp, ftree_node&& opd);
 };
 struct binary_node {
     opr::binary_opr tp;
     node_ptr opd_1, opd_2;
     binary_node(opr::binary_opr tp, node_ptr opd_1, node_ptr opd_2)
         : tp(tp), opd_1(std::move(opd_1)), opd_2(std::move(opd_2)) {}
-    binary_node(opr::binary_opr tp, ftree_node opd_1, ftree_node opd_2)
-        : tp(tp), opd_1(std::make_unique<ftree_node>(opd_1)),
-        opd_2(std::make_unique<ftree_node>(opd_2)) {}
+    binary_node(opr::binary_opr tp, ftree_node&& opd_1, ftree_node&& opd_2);
 };
 
 template<opr::ternary_opr>
@@ -42,8 +42,7 @@ template<>
 struct ternary_node<opr::ternary_opr::ways> {
     node_ptr opd_1, opd_2;
     ternary_node(node_ptr opd_1, node_ptr opd_2) : opd_1(std::move(opd_1)), opd_2(std::move(opd_2)) {}
-    ternary_node(ftree_node opd_1, ftree_node opd_2)
-        : opd_1(std::make_unique<ftree_node>(opd_1)), opd_2(std::make_unique<ftree_node>(opd_2)) {}
+    ternary_node(ftree_node&& opd_1, ftree_node&& opd_2);
 };
 template<>
 struct ternary_node<opr::ternary_opr::condition> {
@@ -51,29 +50,189 @@ struct ternary_node<opr::ternary_opr::condition> {
     std::unique_ptr<ternary_node<opr::ternary_opr::ways>> ways;
     ternary_node(std::unique_ptr<ftree_node> condition, std::unique_ptr<ternary_node<opr::ternary_opr::ways>> ways)
         : condition(std::move(condition)), ways(std::move(ways)) {}
-    ternary_node(ftree_node condition, ternary_node<opr::ternary_opr::ways> ways)
-        : condition(std::make_unique<ftree_node>(condition)),
-        ways(std::make_unique<ternary_node<opr::ternary_opr::ways>>(ways)) {}
+    ternary_node(ftree_node&& condition, ternary_node<opr::ternary_opr::ways>&& ways);
 };
 
-using ftree_node = std::variant<
+// A struct rather than an alias, so that the nodes above can hold it before it is complete
+struct ftree_node : std::variant<
                         ftree_leaf, unary_node, binary_node,
                         ternary_node<opr::ternary_opr::condition>,
                         ternary_node<opr::ternary_opr::ways>
-                        >;
+                        > {
+    using variant::variant;
+};
+
+// One allocation for an operand given by value
+inline node_ptr _own(ftree_node&& opd) {
+    return trims::make_counted<ftree_node>(std::move(opd));
+}
+
+inline unary_node::unary_node(opr::unary_opr tp, ftree_node&& opd) : tp(tp), opd(_own(std::move(opd))) {}
+
+inline binary_node::binary_node(opr::binary_opr tp, ftree_node&& opd_1, ftree_node&& opd_2)
+    : tp(tp), opd_1(_own(std::move(opd_1))), opd_2(_own(std::move(opd_2))) {}
+
+inline ternary_node<opr::ternary_opr::ways>::ternary_node(ftree_node&& opd_1, ftree_node&& opd_2)
+    : opd_1(_own(std::move(opd_1))), opd_2(_own(std::move(opd_2))) {}
+
+inline ternary_node<opr::ternary_opr::condition>::ternary_node(ftree_node&& condition, 
+                                                               ternary_node<opr::ternary_opr::ways>&& ways)
+    : condition(_own(std::move(condition))), 
+    ways(trims::make_counted<ternary_node<opr::ternary_opr::ways>>(std::move(ways))) {}
 
 }
 
 using tree_node = _tree_node::ftree_node;
 
+// Nodes of a tree, that are laid out in a node_arena, refer to their operands by index there
+using node_index = uint32_t;
+
+enum class node_kind : uint8_t {
+    leaf, unary, binary,
+    condition, ways
+};
+
+// Either the text of a leaf or the indices of up to two operands. The second operand of a condition
+// is its ways node, as in ternary_node
+struct arena_node {
+    node_kind kind;
+    uint8_t tp;
+    uint32_t length;
+    union {
+        const char* text;
+        node_index opds[2];
+    };
+
+    static arena_node leaf(_tree_node::leaf_type tp, std::string_view expr) noexcept {
+        arena_node node = _of(node_kind::leaf, std::to_underlying(tp));
+        return node.length = expr.size(), node.text = expr.data(), node;
+    }
+    static arena_node unary(opr::unary_opr tp, node_index opd) noexcept {
+        return _of(node_kind::unary, std::to_underlying(tp), opd);
+    }
+    static arena_node binary(opr::binary_opr tp, node_index opd_1, node_index opd_2) noexcept {
+        return _of(node_kind::binary, std::to_underlying(tp), opd_1, opd_2);
+    }
+    static arena_node ways(node_index opd_1, node_index opd_2) noexcept {
+        return _of(node_kind::ways, std::to_underlying(opr::ternary_opr::ways), opd_1, opd_2);
+    }
+    static arena_node condition(node_index condition, node_index ways) noexcept {
+        return _of(node_kind::condition, std::to_underlying(opr::ternary_opr::condition), condition, ways);
+    }
+
+    _tree_node::leaf_type leaf_tp() const noexcept { return static_cast<_tree_node::leaf_type>(tp); }
+    std::string_view expr() const noexcept { return { text, length }; }
+    opr::opr opr_tp() const noexcept {
+        if (kind == node_kind::unary)
+            return static_cast<opr::unary_opr>(tp);
+        if (kind == node_kind::binary)
+            return static_cast<opr::binary_opr>(tp);
+        return static_cast<opr::ternary_opr>(tp);
+    }
+private:
+    static arena_node _of(node_kind kind, uint8_t tp, node_index opd_1 = 0, node_index opd_2 = 0) noexcept {
+        arena_node node;
+        node.kind = kind, node.tp = tp, node.length = 0, node.opds[0] = opd_1, node.opds[1] = opd_2;
+        return node;
+    }
+};
+
+// Nodes in chunks, that never move, so indices and references stay valid as a tree grows.
+// Chunks double from 64 nodes up to 4096, so that a small tree takes little memory and a large one
+// takes few chunks. reset drops all of them at once and keeps the chunks for the next tree
+class node_arena {
+private:
+    static constexpr uint64_t first_bits = 6, last_bits = 12;
+    static constexpr uint64_t doubling_nodes = (uint64_t(1) << last_bits) - (uint64_t(1) << first_bits);
+    trims::counted_vector<std::unique_ptr<arena_node[]>> _chunks;
+    node_index _size = 0;
+    uint64_t _capacity = 0;
+
+    // Doubling chunk k holds the nodes from 64 * (2^k - 1) on
+    static std::pair<size_t, uint64_t> _locate(node_index i) noexcept {
+        if (i < doubling_nodes) {
+            uint64_t biased = i + (uint64_t(1) << first_bits);
+            size_t chunk = std::bit_width(biased) - 1 - first_bits;
+            return { chunk, biased - (uint64_t(1) << (chunk + first_bits)) };
+        }
+        uint64_t past = i - doubling_nodes;
+        return { last_bits - first_bits + (past >> last_bits), past & ((uint64_t(1) << last_bits) - 1) };
+    }
+public:
+    node_index add(const arena_node& node) {
+        if (_size == _capacity) {
+            uint64_t chunk_size = uint64_t(1) << std::min(first_bits + _chunks.size(), last_bits);
+            _chunks.push_back(trims::make_counted_for_overwrite<arena_node[]>(chunk_size));
+            _capacity += chunk_size;
+        }
+        (*this)[_size] = node;
+        return _size++;
+    }
+
+    arena_node& operator[](node_index i) noexcept {
+        auto [chunk, at] = _locate(i);
+        return _chunks[chunk][at];
+    }
+    const arena_node& operator[](node_index i) const noexcept {
+        auto [chunk, at] = _locate(i);
+        return _chunks[chunk][at];
+    }
+    node_index size() const noexcept { return _size; }
+    void reset() noexcept { _size = 0; }
+};
+
+// Leaves view the source or the text arena, that the tree owns. Nodes are kept in its node arena in post-order,
+// the root last, trees of nodes given by pointers are laid out there so
 class ftree {
 private:
-    std::unique_ptr<tree_node> _root;
+    node_arena _nodes;
+    node_index _root;
+    trims::text_arena _text;
+
+    node_index _lay_out(const tree_node& node);
 public:
-    ftree(std::unique_ptr<tree_node> root) : _root(std::move(root)) {}
-    ftree(tree_node root) : _root(std::make_unique<tree_node>(root)) {}
+    ftree(node_arena nodes, node_index root, trims::text_arena text)
+        : _nodes(std::move(nodes)), _root(root), _text(std::move(text)) {}
+    ftree(std::unique_ptr<tree_node> root) : _root(_lay_out(*root)) {}
+    ftree(const tree_node& root) : _root(_lay_out(root)) {}
+    ftree(const tree_node& root, trims::text_arena text) : _root(_lay_out(root)), _text(std::move(text)) {}
+    ftree(std::unique_ptr<tree_node> root, trims::text_arena text)
+        : _root(_lay_out(*root)), _text(std::move(text)) {}
     ftree(_tree_node::leaf_type tp, std::string_view expr)
-        : _root(std::make_unique<tree_node>(tp, expr)) {}
+        : _root(_nodes.add(arena_node::leaf(tp, expr))) {}
+
+    node_index root() const noexcept { return _root; }
+    const arena_node& operator[](node_index i) const noexcept { return _nodes[i]; }
+    const node_arena& nodes() const noexcept { return _nodes; }
 };
 
+// Operands are laid out before the nodes, that apply to them
+inline node_index ftree::_lay_out(const tree_node& node) {
+    namespace tn = _tree_node;
+    using ways_node = tn::ternary_node<opr::ternary_opr::ways>;
+    using condition_node = tn::ternary_node<opr::ternary_opr::condition>;
+    auto lay_out_ways = [&](const ways_node& ways) {
+        node_index opd_1 = _lay_out(*ways.opd_1);
+        return _nodes.add(arena_node::ways(opd_1, _lay_out(*ways.opd_2)));
+    };
+    if (std::holds_alternative<tn::ftree_leaf>(node)) {
+        const tn::ftree_leaf& leaf = std::get<tn::ftree_leaf>(node);
+        return _nodes.add(arena_node::leaf(leaf.tp, leaf.expr));
+    }
+    if (std::holds_alternative<tn::unary_node>(node)) {
+        const tn::unary_node& unary = std::get<tn::unary_node>(node);
+        return _nodes.add(arena_node::unary(unary.tp, _lay_out(*unary.opd)));
+    }
+    if (std::holds_alternative<tn::binary_node>(node)) {
+        const tn::binary_node& binary = std::get<tn::binary_node>(node);
+        node_index opd_1 = _lay_out(*binary.opd_1);
+        return _nodes.add(arena_node::binary(binary.tp, opd_1, _lay_out(*binary.opd_2)));
+    }
+    if (std::holds_alternative<ways_node>(node))
+        return lay_out_ways(std::get<ways_node>(node));
+    const condition_node& condition = std::get<condition_node>(node);
+    node_index opd = _lay_out(*condition.condition);
+    return _nodes.add(arena_node::condition(opd, lay_out_ways(*condition.ways)));
+}
+
 }
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "trims_fs.h"
+#include "trims_dfa.h"
+
+namespace lexer {
+
+enum class token_kind : uint8_t {
+    num_literal, str_literal, ident, opr,
+    open_brace, close_brace,
+    special_open_brace, special_close_brace,
+    semicolon, end, incorrect
+};
+
+// Piece of the source, that is classified once. opr is the id of operators, as in opr::id_of,
+// incorrect tokens are one byte long. A number, that an identifier byte follows right away, is incorrect
+// at its first digit, as a literal like 12abc is neither a number nor a name
+struct token {
+    token_kind kind;
+    opr::opr_id opr;
+    uint32_t length;
+    tf::index_t offset;
+};
+
+// Splits a trim string into tokens in a single pass, K tokens ahead. The trim string is kept at the last
+// token taken, so the text of it and of the ones ahead stays buffered, to be read or pinned
+template<class S, size_t K = 2>
+class token_stream {
+private:
+    static constexpr scan::char_class spacing = scan::classes::space | scan::classes::linebreak;
+
+    S* _src;
+    std::array<token, K> _ahead;
+    size_t _front;
+    tf::index_t _pos;
+
+    // Most numbers are plain integers, they are read by the class scan. Only a run of digits, that goes on
+    // with a literal byte, is read again by the full rule
+    tf::trim_fn_rslt _number(tf::index_t from) {
+        tf::trim_fn_rslt end = tf::invoke_fast(trim_while_in_t(scan::classes::digit), *_src, from);
+        if (*end == _src->size())
+            return end;
+        if (unsigned char c = (*_src)[*end]; scan::is(c, scan::kinds::ident) || c == '.')
+            end = tf::invoke_fast(tf::ptf::trim_number, *_src, from);
+        if (end && *end < _src->size() && scan::is((*_src)[*end], scan::kinds::ident))
+            return std::unexpected(from);
+        return end;
+    }
+    token _lex() {
+        _pos = *tf::invoke_fast(trim_while_in_t(spacing), *_src, _pos);
+        tf::index_t from = _pos;
+        if (from >= _src->size())
+            return { token_kind::end, 0, 0, from };
+        unsigned char c = (*_src)[from];
+        token_kind kind = token_kind::incorrect;
+        tf::trim_fn_rslt end = std::unexpected(from);
+        opr::opr_id id = 0;
+        if (scan::is(c, scan::kinds::digit)) {
+            kind = token_kind::num_literal, end = _number(from);
+        } else if (scan::is(c, scan::kinds::ident)) {
+            kind = token_kind::ident, end = tf::invoke_fast(tf::ptf::trim_identifier, *_src, from);
+        } else if (scan::is(c, scan::kinds::quote)) {
+            kind = token_kind::str_literal, end = tf::invoke_fast(tf::ptf::trim_string_literal, *_src, from);
+        } else if (scan::is(c, scan::kinds::open_brace)) {
+            kind = token_kind::open_brace, end = from + 1;
+        } else if (scan::is(c, scan::kinds::close_brace)) {
+            kind = token_kind::close_brace, end = from + 1;
+        } else if (scan::is(c, scan::kinds::special_open_brace)) {
+            kind = token_kind::special_open_brace, end = from + 1;
+        } else if (scan::is(c, scan::kinds::special_close_brace)) {
+            kind = token_kind::special_close_brace, end = from + 1;
+        } else if (scan::is(c, scan::kinds::semicolon)) {
+            kind = token_kind::semicolon, end = from + 1;
+        } else if (auto match = opr::match_opr(_src->substr(from, opr::opr_trie::max_length)); match.length) {
+            kind = token_kind::opr, end = from + match.length, id = match.id;
+        }
+        if (!end)
+            return _pos = from + 1, token{ token_kind::incorrect, 0, 1, from };
+        _pos = *end;
+        return { kind, id, static_cast<uint32_t>(*end - from), from };
+    }
+    void _fill() {
+        _front = 0;
+        for (token& tok : _ahead)
+            tok = _lex();
+    }
+public:
+    token_stream(S& src) : _src(&src), _front(0), _pos(src.pos()) { _fill(); }
+
+    const token& peek(size_t i = 0) const noexcept { return _ahead[(_front + i) % K]; }
+    token next() {
+        token tok = _ahead[_front];
+        _src->apply(tf::trim_to, tok.offset);
+        _ahead[_front] = _lex(), _front = (_front + 1) % K;
+        return tok;
+    }
+    // Drops the tokens ahead and goes on from pos, for pieces that are taken whole, like arguments
+    void skip_to(tf::index_t pos) {
+        _src->apply(tf::trim_to, pos);
+        _pos = pos, _fill();
+    }
+
+    std::string_view text(const token& tok) const { return _src->substr(tok.offset, tok.length); }
+};
+
+}
@@ -1,5 +1,13 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <expected>
+#include <string_view>
+#include <utility>
+#include <variant>
+
 namespace operators {
     
 enum class unary_opr {
@@ -34,6 +42,16 @@ enum class ternary_opr {
     _count = 2
 };
 
+using opr = std::variant<unary_opr, binary_opr, ternary_opr>;
+
+enum class associativity {
+    left_to_right, right_to_left, none
+};
+
+constexpr associativity _ltr = associativity::left_to_right;
+constexpr associativity _rtl = associativity::right_to_left;
+constexpr associativity _none = associativity::none;
+
 template<class T>
 concept type_ok =
     std::is_same_v<unary_opr, T> || std::is_same_v<binary_opr, T> || std::is_same_v<ternary_opr, T>;
@@ -71,29 +89,6 @@ struct priority<ternary_opr> {
     }
 };
 
-inline size_t opr_priority(opr _opr) noexcept {
-    if (std::holds_alternative<unary_opr>(_opr))
-        return priority<unary_opr>()(std::get<unary_opr>(_opr));
-    if (std::holds_alternative<binary_opr>(_opr))
-        return priority<binary_opr>()(std::get<binary_opr>(_opr));
-    if (std::holds_alternative<ternary_opr>(_opr))
-        return priority<ternary_opr>()(std::get<ternary_opr>(_opr));
-}
-
-inline bool __cmp(opr opr_1, opr opr_2) {
-    return (opr_assoc(opr_2) == _ltr
-                ? opr_priority(opr_1) >= opr_priority(opr_2)
-                : opr_priority(opr_1) > opr_priority(opr_2));
-}
-
-enum class associativity {
-    left_to_right, right_to_left, none
-};
-
-constexpr associativity _ltr = associativity::left_to_right;
-constexpr associativity _rtl = associativity::right_to_left;
-constexpr associativity _none = associativity::none;
-
 template<type_ok T>
 struct associative {
 };
@@ -131,22 +126,13 @@ struct associative<ternary_opr> {
 template<type_ok T>
 using assoc = associative<T>;
 
-inline associativity opr_assoc(opr _opr) noexcept {
-    if (std::holds_alternative<unary_opr>(_opr))
-        return assoc<unary_opr>()(std::get<unary_opr>(_opr));
-    if (std::holds_alternative<binary_opr>(_opr))
-        return assoc<binary_opr>()(std::get<binary_opr>(_opr));
-    if (std::holds_alternative<ternary_opr>(_opr))
-        return assoc<ternary_opr>()(std::get<ternary_opr>(_opr));
-}
-
 template<type_ok T>
 struct opr_design {
 };
 
 template<>
 struct opr_design<unary_opr> {
-    static constexpr std::array<char*, std::to_underlying(unary_opr::_count)> arr = {
+    static constexpr std::array<std::string_view, std::to_underlying(unary_opr::_count)> arr = {
         "!", "++", "--", "++", "--", "+", "-", "!", "~", "&", "*", "&&"
     };
     unary_opr operator()(std::string_view opr_design) const noexcept {
@@ -156,7 +142,7 @@ struct opr_design<unary_opr> {
 
 template<>
 struct opr_design<binary_opr> {
-    static constexpr std::array<char*, std::to_underlying(binary_opr::_count)> arr = {
+    static constexpr std::array<std::string_view, std::to_underlying(binary_opr::_count)> arr = {
         "::", "->", ".", "()", "*", "/", "%", "+", "-", "<<", ">>", "<", "<=", ">", ">=", "==",
         "!=", "&", "^", "|", "&&", "||", "=", "+=", "-=", "*=", "/=", "%=", "<<=", ">>=",
         "&=", "|=", "^=", ","
@@ -168,22 +154,160 @@ struct opr_design<binary_opr> {
 
 template<>
 struct opr_design<ternary_opr> {
-    static constexpr std::array<char*, std::to_underlying(ternary_opr::_count)> arr = { "?", ":" };
+    static constexpr std::array<std::string_view, std::to_underlying(ternary_opr::_count)> arr = { "?", ":" };
     ternary_opr operator()(std::string_view opr_design) const noexcept {
         return static_cast<ternary_opr>(std::find(arr.begin(), arr.end(), opr_design) - arr.begin());
     }
 };
 
-using opr = std::variant<unary_opr, binary_opr, ternary_opr>;
+// Operators are numbered in one row, unary ones first, then binary and ternary ones
+using opr_id = uint8_t;
+
+constexpr opr_id unary_oprs = std::to_underlying(unary_opr::_count);
+constexpr opr_id binary_oprs = std::to_underlying(binary_opr::_count);
+constexpr opr_id ternary_oprs = std::to_underlying(ternary_opr::_count);
+
+constexpr opr_id id_of(opr _opr) noexcept {
+    constexpr opr_id offsets[] = { 0, unary_oprs, unary_oprs + binary_oprs };
+    return offsets[_opr.index()] + std::visit([](auto tp) { return opr_id(std::to_underlying(tp)); }, _opr);
+}
+
+constexpr opr opr_of(opr_id id) noexcept {
+    if (id < unary_oprs)
+        return static_cast<unary_opr>(id);
+    if (id < unary_oprs + binary_oprs)
+        return static_cast<binary_opr>(id - unary_oprs);
+    return static_cast<ternary_opr>(id - unary_oprs - binary_oprs);
+}
+
+struct opr_match {
+    opr_id id;
+    uint8_t length;
+};
+
+// Byte trie over the spellings of all operators, 3 levels deep. Bytes, that no spelling has, share column 0,
+// so that a node is a short row of next nodes. A spelling of several operators stands for the first one
+class opr_trie {
+private:
+    static constexpr size_t max_nodes = 64, max_columns = 32;
+
+    std::array<uint8_t, 256> _column {};
+    std::array<std::array<uint8_t, max_columns>, max_nodes> _next {};
+    std::array<opr_id, max_nodes> _ids {};
+    std::array<bool, max_nodes> _accepts {};
+    uint8_t _nodes = 1, _columns = 1;
+
+    constexpr void _insert(std::string_view spelling, opr_id id) {
+        uint8_t node = 0;
+        for (char c : spelling) {
+            uint8_t& column = _column[static_cast<unsigned char>(c)];
+            if (!column)
+                column = _columns++;
+            uint8_t& next = _next[node][column];
+            if (!next)
+                next = _nodes++;
+            node = next;
+        }
+        if (!_accepts[node])
+            _accepts[node] = true, _ids[node] = id;
+    }
+public:
+    static constexpr size_t max_length = 3;
+
+    constexpr opr_trie() {
+        opr_id id = 0;
+        for (std::string_view spelling : opr_design<unary_opr>::arr)
+            _insert(spelling, id++);
+        for (std::string_view spelling : opr_design<binary_opr>::arr)
+            _insert(spelling, id++);
+        for (std::string_view spelling : opr_design<ternary_opr>::arr)
+            _insert(spelling, id++);
+    }
+
+    // Longest spelling, that chars start with, its length is 0 if there is none
+    constexpr opr_match operator()(std::string_view chars) const noexcept {
+        opr_match match { 0, 0 };
+        uint8_t node = 0;
+        for (size_t i = 0; i < std::min(chars.size(), max_length); ++i) {
+            if (!(node = _next[node][_column[static_cast<unsigned char>(chars[i])]]))
+                break;
+            if (_accepts[node])
+                match = { _ids[node], static_cast<uint8_t>(i + 1) };
+        }
+        return match;
+    }
+};
+
+inline constexpr opr_trie match_opr;
+
+constexpr opr_id no_opr = 0xff;
+constexpr opr_id oprs = unary_oprs + binary_oprs + ternary_oprs;
+// Open brace of a group waits on the stack among operators, but is never applied
+constexpr opr_id group = oprs;
+
+// Everything about an operator by its id. The one waiting on the stack is applied before the coming one, 
+// if its lhs_key isnt less than the rhs_key of the coming one. Keys grow as priority gets higher (its number lower),
+// equal priorities are applied first only if left to right. Prefix operators apply nothing, as they come
+struct opr_info {
+    std::string_view spelling;
+    uint8_t prio, arity;
+    associativity assoc;
+    uint8_t lhs_key, rhs_key;
+    // Operators, that the same spelling stands for after an operand and before one, if any
+    opr_id infix, prefix;
+};
+
+inline constexpr std::array<opr_info, oprs + 1> opr_table = [] {
+    constexpr uint8_t lowest = 16;
+
+    std::array<opr_info, oprs + 1> table {};
+    auto add = [&]<type_ok T>(T tp, uint8_t arity) {
+        opr_info& info = table[id_of(tp)];
+        info.spelling = opr_design<T>::arr[std::to_underlying(tp)];
+        info.prio = priority<T>()(tp), info.arity = arity, info.assoc = assoc<T>()(tp);
+        bool prefix = arity == 1 && info.assoc != _ltr;
+        info.lhs_key = 2 * (lowest - info.prio);
+        info.rhs_key = prefix ? 0xff : info.lhs_key + (info.assoc != _ltr);
+    };
+    for (uint8_t i = 0; i < unary_oprs; ++i)
+        add(static_cast<unary_opr>(i), 1);
+    for (uint8_t i = 0; i < binary_oprs; ++i)
+        add(static_cast<binary_opr>(i), 2);
+    for (uint8_t i = 0; i < ternary_oprs; ++i)
+        add(static_cast<ternary_opr>(i), 3);
+    for (opr_id id = 0; id < oprs; ++id) {
+        table[id].infix = table[id].prefix = no_opr;
+        for (opr_id same = oprs; same--; ) {
+            if (table[same].spelling != table[id].spelling)
+                continue;
+            if (table[same].arity == 1 && table[same].assoc != _ltr)
+                table[id].prefix = same;
+            else
+                table[id].infix = same;
+        }
+    }
+    table[group] = { "(", lowest, 0, _none, 0, 0, no_opr, no_opr };
+    return table;
+}();
+
+inline size_t opr_priority(opr _opr) noexcept {
+    return opr_table[id_of(_opr)].prio;
+}
+
+inline associativity opr_assoc(opr _opr) noexcept {
+    return opr_table[id_of(_opr)].assoc;
+}
+
+// Whether opr_1, waiting on the stack, is applied before opr_2 comes
+inline bool __cmp(opr opr_1, opr opr_2) {
+    return opr_table[id_of(opr_1)].lhs_key >= opr_table[id_of(opr_2)].rhs_key;
+}
 
-std::expected<opr, std::string_view> opr_char(std::string_view opr_char) noexcept {
-    opr rslt = opr_design<unary_opr>()(opr_char);
-    if (std::get<unary_opr>(rslt) != unary_opr::_count) return rslt;
-    rslt = opr_design<binary_opr>()(opr_char);
-    if (std::get<binary_opr>(rslt) != binary_opr::_count) return rslt;
-    rslt = opr_design<ternary_opr>()(opr_char);
-    if (std::get<ternary_opr>(rslt) != ternary_opr::_count) return rslt;
-    return std::unexpected(opr_char);
+inline std::expected<opr, std::string_view> opr_char(std::string_view opr_char) noexcept {
+    opr_match match = match_opr(opr_char);
+    if (!match.length || match.length != opr_char.size())
+        return std::unexpected(opr_char);
+    return opr_of(match.id);
 }
 
 }
@@ -1,14 +1,8 @@
 #pragma once
 
-#include "ftree.h"
+#include <stack>
 
-namespace pf {
-
-using index_t = uint64_t;
-using fn_rslt = std::expected<void, parse_exp::error>;   
-using parse_rslt = std::expected<ftree::ftree, parse_exp::error>;
-
-}
+#include "flat_ftree.h"
 
 namespace parse_exp {
 
@@ -22,10 +16,47 @@ enum class error {
     incorrect_char, text_isnt_expr
 };
 
+}
+
+namespace pf {
+
+using index_t = uint64_t;
+using fn_rslt = std::expected<void, parse_exp::error>;   
+using parse_rslt = std::expected<ftree::ftree, parse_exp::error>;
+using flat_rslt = std::expected<ftree::flat_ftree, parse_exp::error>;
+// Stack of the engines, its allocations are counted as the ones of the arenas
+template<class T>
+using stack = std::stack<T, trims::counted_vector<T>>;
+
+}
+
+namespace parse_exp {
+
 std::string get_error_message(error code);
 std::string get_error_message(error code, size_t pos);
 
-pf::fn_rslt push_opr(opr::opr pushed, std::stack<ftree::tree_node>& opds);
+pf::fn_rslt push_opr(opr::opr pushed, pf::stack<ftree::node_index>& opds, ftree::node_arena& nodes);
+// Allocations of a call are counted by a trims::count_allocs around it. The containers, that a trim string
+// is given, are the caller's and arent counted
 pf::parse_rslt parse_exp(trims::ex_trim_str expr);
+pf::parse_rslt parse_exp(trims::mapped_ex_trim_str expr);
+pf::parse_rslt parse_exp(trims::view_ex_trim_str expr);
+pf::parse_rslt parse_exp(trims::mapped_span_ex_trim_str expr);
+pf::parse_rslt parse_exp(trims::view_span_ex_trim_str expr);
+pf::parse_rslt parse_exp(std::string_view expr);
+pf::flat_rslt parse_exp_flat(trims::ex_trim_str expr);
+pf::flat_rslt parse_exp_flat(trims::mapped_ex_trim_str expr);
+pf::flat_rslt parse_exp_flat(trims::view_ex_trim_str expr);
+pf::flat_rslt parse_exp_flat(trims::mapped_span_ex_trim_str expr);
+pf::flat_rslt parse_exp_flat(trims::view_span_ex_trim_str expr);
+pf::flat_rslt parse_exp_flat(std::string_view expr);
+
+// Same grammar and tree, parsed by precedence climbing instead of a shunting yard
+pf::parse_rslt parse_exp_pratt(trims::ex_trim_str expr);
+pf::parse_rslt parse_exp_pratt(trims::mapped_ex_trim_str expr);
+pf::parse_rslt parse_exp_pratt(trims::view_ex_trim_str expr);
+pf::parse_rslt parse_exp_pratt(trims::mapped_span_ex_trim_str expr);
+pf::parse_rslt parse_exp_pratt(trims::view_span_ex_trim_str expr);
+pf::parse_rslt parse_exp_pratt(std::string_view expr);
 
 }
@@ -1,5 +1,7 @@
+#include <optional>
 #include <stack>
 
+#include "include/lexer.h"
 #include "include/parse_exp.h"
 
 namespace parse_exp {
@@ -56,209 +58,247 @@ std::string get_error_message(error code, size_t pos) {
         return "Incorrect char in " + std::to_string(pos);
 }
 
-pf::fn_rslt push_opr(opr::opr pushed, std::stack<ftree::tree_node>& opds) {
+pf::fn_rslt push_opr(opr::opr pushed, pf::stack<ftree::node_index>& opds, ftree::node_arena& nodes) {
     using t_opr = opr::ternary_opr;
+    auto is_ways = [&](ftree::node_index opd) { return nodes[opd].kind == ftree::node_kind::ways; };
     if (std::holds_alternative<opr::unary_opr>(pushed)) {
         opr::unary_opr u_opr = std::get<opr::unary_opr>(pushed);
         if (!opds.size())
             return std::unexpected(error::couldnt_find_operand);
-        if (std::holds_alternative<ftree::_tree_node::ternary_node<t_opr::ways>>(opds.top()))
+        if (is_ways(opds.top()))
             return std::unexpected(error::piece_of_ternary_opr);
-        ftree::_tree_node::unary_node u_node(u_opr, std::move(opds.top()));
-        opds.pop();
-        opds.push(std::move(u_node));
+        opds.top() = nodes.add(ftree::arena_node::unary(u_opr, opds.top()));
     } else if (std::holds_alternative<opr::binary_opr>(pushed)) {
         opr::binary_opr bin_opr = std::get<opr::binary_opr>(pushed);
         if (opds.size() < 2)
             return std::unexpected(error::couldnt_find_operand);
-        if (std::holds_alternative<ftree::_tree_node::ternary_node<t_opr::ways>>(opds.top()))
+        if (is_ways(opds.top()))
             return std::unexpected(error::piece_of_ternary_opr);
-        ftree::tree_node _node(std::move(opds.top()));
+        ftree::node_index _node = opds.top();
         opds.pop();
-        if (std::holds_alternative<ftree::_tree_node::ternary_node<t_opr::ways>>(opds.top()))
+        if (is_ways(opds.top()))
             return std::unexpected(error::piece_of_ternary_opr);
-        ftree::_tree_node::binary_node bin_node(bin_opr, std::move(opds.top()), std::move(_node));
-        opds.pop();
-        opds.push(std::move(bin_node));
+        opds.top() = nodes.add(ftree::arena_node::binary(bin_opr, opds.top(), _node));
     } else if (std::holds_alternative<t_opr>(pushed)) {
         t_opr tern_opr = std::get<t_opr>(pushed);
         if (opds.size() < 2)
             return std::unexpected(error::couldnt_find_operand);
         if (tern_opr == t_opr::ways) {
-            if (std::holds_alternative<ftree::_tree_node::ternary_node<t_opr::ways>>(opds.top()))
+            if (is_ways(opds.top()))
                 return std::unexpected(error::piece_of_ternary_opr);
-            ftree::tree_node _node(std::move(opds.top()));
+            ftree::node_index _node = opds.top();
             opds.pop();
-            if (std::holds_alternative<ftree::_tree_node::ternary_node<t_opr::ways>>(opds.top()))
+            if (is_ways(opds.top()))
                 return std::unexpected(error::piece_of_ternary_opr);
-            ftree::_tree_node::ternary_node<t_opr::ways> t_node(std::move(opds.top()), std::move(_node));
-            opds.pop();
-            opds.push(std::move(t_node));
+            opds.top() = nodes.add(ftree::arena_node::ways(opds.top(), _node));
         } else if (tern_opr == t_opr::condition) {
-            if (!std::holds_alternative<ftree::_tree_node::ternary_node<t_opr::ways>>(opds.top()))
+            if (!is_ways(opds.top()))
                 return std::unexpected(error::piece_of_ternary_opr);
-            ftree::_tree_node::ternary_node<t_opr::ways> _node(
-                    std::move(std::get<ftree::_tree_node::ternary_node<t_opr::ways>>(opds.top())));
+            ftree::node_index _node = opds.top();
             opds.pop();
-            if (std::holds_alternative<ftree::_tree_node::ternary_node<t_opr::ways>>(opds.top()))
+            if (is_ways(opds.top()))
                 return std::unexpected(error::piece_of_ternary_opr);
-            ftree::_tree_node::ternary_node<t_opr::condition> t_node(std::move(opds.top()), std::move(_node));
-            opds.pop();
-            opds.push(std::move(t_node));
+            opds.top() = nodes.add(ftree::arena_node::condition(opds.top(), _node));
         }
     }
+    return {};
 }
 
-pf::parse_rslt parse_exp(trims::ex_trim_str expr) {
+template<class ExTrimStr>
+pf::parse_rslt _parse_exp(ExTrimStr& expr) {
     namespace tn = ftree::_tree_node;
     bool is_node = false;
-    std::stack<ftree::tree_node> opds;
-    std::stack<std::variant<opr::opr, char>> oprs;
-    for (tf::index_t i = 0; i < expr.size(); ++i) {
-        if (tf::ptf::is_space(expr[i])) {
-            i = expr.apply(tf::trim_spaces).pos();
-        } else if (tf::ptf::is_linebreak(expr[i])) {
-            i = expr.apply(trim_while_true_t(tf::ptf::is_linebreak)).pos();
-        } else if (tf::ptf::is_semicolon(expr[i])) {
-            if (*tf::trim_while_true(expr, i + 1, [](int c) -> int {
-                    return tf::ptf::is_semicolon(c) || tf::ptf::is_linebreak(c); }) != expr.size())
+    // Nodes are laid out as they are made, operands before the operators
+    ftree::node_arena nodes;
+    pf::stack<ftree::node_index> opds;
+    pf::stack<opr::opr_id> oprs;
+    // Text of leaves, that the source doesnt keep, is moved here and handed to the tree
+    trims::text_arena text;
+    // Brackets of a text, that is resident as a whole, are matched once up front, 
+    // otherwise each one is matched from the open bracket on
+    std::optional<scan::bracket_index> brackets;
+    if (auto resident = expr.window(0); !resident.begin() && resident.end() == expr.size())
+        brackets.emplace(resident.data(0), resident.end());
+    auto find_close = [&](tf::index_t open) -> tf::trim_fn_rslt {
+        auto rslt = brackets ? tf::trim_until_match(expr, open, *brackets) : tf::trim_until_close(expr, open);
+        if (!rslt)
+            return rslt;
+        return *rslt - 1;
+    };
+    lexer::token_stream tokens(expr);
+    for (lexer::token tok = tokens.next(); tok.kind != lexer::token_kind::end; tok = tokens.next()) {
+        using lexer::token_kind;
+        if (tok.kind == token_kind::semicolon) {
+            while (tokens.peek().kind == token_kind::semicolon)
+                tokens.next();
+            if (tokens.peek().kind != token_kind::end)
                 return std::unexpected(error::text_isnt_expr);
             break;
-        } else if (tf::ptf::is_alph_num(expr[i])) {
-            expr.extract_next();
-            if (expr.apply(tf::ptf::trim_num_literal).err())
-                return std::unexpected(error::couldnt_read_num_literal);
-            i = expr.pos();
-            opds.push(tn::ftree_leaf(tn::leaf_type::num_literal, expr.pop_extracted()));
+        } else if (tok.kind == token_kind::num_literal) {
+            opds.push(nodes.add(ftree::arena_node::leaf(tn::leaf_type::num_literal,
+                expr.pin(tok.offset, tok.length, text))));
             is_node = true;
-        } else if (tf::ptf::is_quote(expr[i])) {
-            expr.extract_next();
-            if (expr.apply(tf::ptf::trim_string_literal).err())
-                return std::unexpected(error::couldnt_read_string_literal);
-            i = expr.pos();
-            opds.push(tn::ftree_leaf(tn::leaf_type::str_literal, expr.pop_extracted()));
+        } else if (tok.kind == token_kind::str_literal) {
+            opds.push(nodes.add(ftree::arena_node::leaf(tn::leaf_type::str_literal,
+                expr.pin(tok.offset, tok.length, text))));
             is_node = true;
-        } else if (tf::ptf::is_alpha(expr[i])) {
-            expr.extract_next();
-            i = expr.apply(tf::ptf::trim_token).pos();
-            opds.push(tn::ftree_leaf(tn::leaf_type::var, expr.pop_extracted()));
+        } else if (tok.kind == token_kind::ident) {
+            opds.push(nodes.add(ftree::arena_node::leaf(tn::leaf_type::var, expr.pin(tok.offset, tok.length, text))));
             is_node = true;
-        } else if (tf::ptf::is_open_brace(expr[i])) {
-            expr.save_pos(tf::tags::chain);
-            i = (expr[i] == '(' ? expr.apply(trim_char_t('(')).pos() : expr.apply(trim_char_t('[')).pos());
+        } else if (tok.kind == token_kind::open_brace) {
+            char brace = expr[tok.offset];
             if (is_node) {
-                ftree::tree_node _node = std::move(opds.top());
-                opds.pop();
-                expr.extract_next();
-                if (expr.apply(expr[i - 1] == '('
-                        ? trim_while_false_t([](int c) -> int { return c == ')'; })
-                        : trim_while_false_t([](int c) -> int { return c == ']'; })
-                        ).pos() == expr.size())
+                const ftree::arena_node& _node = nodes[opds.top()];
+                if (_node.kind == ftree::node_kind::leaf && _node.leaf_tp() != tn::leaf_type::var && 
+                        _node.leaf_tp() != tn::leaf_type::ctor_call)
+                    return std::unexpected(error::semantics_inconsistency);
+                auto close = find_close(tok.offset);
+                if (!close)
                     return std::unexpected(error::couldnt_find_close_brace);
-                i = (expr[expr.pop_saved()] == '('
-                        ? expr.apply(trim_char_t(')')).pos()
-                        : expr.apply(trim_char_t(']')).pos()
-                    );
-                if (std::holds_alternative<tn::ftree_leaf>(_node)) {
-                    tn::ftree_leaf _leaf = std::get<tn::ftree_leaf>(_node);
-                    if (_leaf.tp == tn::leaf_type::var || _leaf.tp == tn::leaf_type::ctor_call) {
-                        opds.push(tn::binary_node(opr::binary_opr::func_call, _leaf,
-                            tn::ftree_leaf(tn::leaf_type::func_arg, expr.pop_extracted())));
-                    } else {
-                        return std::unexpected(error::semantics_inconsistency);
-                    }
-                } else {
-                    opds.push(tn::binary_node(opr::binary_opr::func_call, std::move(_node),
-                        tn::ftree_leaf(tn::leaf_type::func_arg, expr.pop_extracted())));
-                }
+                ftree::node_index arg = nodes.add(ftree::arena_node::leaf(tn::leaf_type::func_arg, 
+                    expr.pin(tok.offset + 1, *close - tok.offset - 1, text)));
+                tokens.skip_to(*close + 1);
+                opds.top() = nodes.add(ftree::arena_node::binary(opr::binary_opr::func_call, opds.top(), arg));
             } else {
-                if (expr[i - 1] == '(')
-                    oprs.push('(');
+                if (brace == '(')
+                    oprs.push(opr::group);
                 else
                     return std::unexpected(error::couldnt_find_func_ptr);
+                is_node = false;
             }
-            is_node = false;
-        } else if (tf::ptf::is_special_open_brace(expr[i])) {
-            if (is_node) {
-                ftree::tree_node _node = std::move(opds.top());
-                opds.pop();
-                expr.extract_next();
-                if (expr.apply(trim_while_false_t([](int c) -> int { return c == '}'; })).pos() == expr.size())
-                    return std::unexpected(error::couldnt_find_close_brace);
-                i = expr.apply(trim_char_t('}')).pos();
-                if (std::holds_alternative<tn::ftree_leaf>(_node)) {
-                    tn::ftree_leaf _leaf = std::get<tn::ftree_leaf>(_node);
-                    if (_leaf.tp == tn::leaf_type::var) {
-                        opds.push(tn::ftree_leaf(tn::leaf_type::ctor_call, 
-                            static_cast<std::string>(_leaf.expr) + expr.pop_extracted() + '}'));
-                    } else {
-                        return std::unexpected(error::couldnt_find_token);
-                    }
-                } else {
-                    return std::unexpected(error::couldnt_find_token);
-                }
-            } else {
+        } else if (tok.kind == token_kind::special_open_brace) {
+            if (!is_node)
                 return std::unexpected(error::couldnt_find_token);
-            }
+            ftree::arena_node& _node = nodes[opds.top()];
+            auto close = find_close(tok.offset);
+            if (!close)
+                return std::unexpected(error::couldnt_find_close_brace);
+            if (_node.kind != ftree::node_kind::leaf || _node.leaf_tp() != tn::leaf_type::var)
+                return std::unexpected(error::couldnt_find_token);
+            // The name leaf becomes the ctor leaf in place
+            _node = ftree::arena_node::leaf(tn::leaf_type::ctor_call, 
+                text.keep(_node.expr(), expr.substr(tok.offset, *close + 1 - tok.offset)));
+            tokens.skip_to(*close + 1);
             is_node = true;
-        } else if (expr.invoke(tf::ptf::trim_operator)) {
-            expr.extract_next();
-            i = expr.apply(tf::ptf::trim_operator).pos();
-            opr::opr _opr = *opr::opr_char(expr.pop_extracted());
-            if (std::holds_alternative<opr::unary_opr>(_opr)) {
-                opr::unary_opr u_opr = std::get<opr::unary_opr>(_opr);
-                if (is_node) {
-                    if (u_opr == opr::unary_opr::postf_inc) {
-                        _opr = opr::unary_opr::pref_inc;
-                    } else if (u_opr == opr::unary_opr::postf_dec) {
-                        _opr = opr::unary_opr::pref_dec;
-                    }
-                }
-            }
-            while (oprs.size()) {
-                if (std::holds_alternative<char>(oprs.top()) || !opr::__cmp(oprs.top(), _opr))
-                    break;
-                opr::opr pushed = std::get<opr::opr>(oprs.top());
+        } else if (tok.kind == token_kind::opr) {
+            // The spelling means an infix or postfix operator after an operand, and a prefix one before it
+            opr::opr_id id = is_node ? opr::opr_table[tok.opr].infix : opr::opr_table[tok.opr].prefix;
+            if (id == opr::no_opr)
+                return std::unexpected(is_node ? error::couldnt_find_operator : error::couldnt_find_operand);
+            const opr::opr_info& info = opr::opr_table[id];
+            while (oprs.size() && opr::opr_table[oprs.top()].lhs_key >= info.rhs_key) {
+                auto rslt = push_opr(opr::opr_of(oprs.top()), opds, nodes);
                 oprs.pop();
-                auto rslt = push_opr(pushed, opds);
                 if (!rslt)
                     return std::unexpected(rslt.error());
             }
-            oprs.push(_opr);
-            is_node = false;
-        } else if (tf::ptf::is_close_brace(expr[i])) {
-            i = expr.apply(trim_char_t(')')).pos();
-            while (oprs.size()) {
-                if (std::holds_alternative<char>(oprs.top()))
-                    break;
-                opr::opr pushed = std::get<opr::opr>(oprs.top());
+            // A postfix operator has its whole operand already, nothing after it can be a part of it
+            is_node = info.arity == 1 && info.assoc == opr::_ltr;
+            if (is_node) {
+                if (auto rslt = push_opr(opr::opr_of(id), opds, nodes); !rslt)
+                    return std::unexpected(rslt.error());
+            } else {
+                oprs.push(id);
+            }
+        } else if (tok.kind == token_kind::close_brace) {
+            while (oprs.size() && oprs.top() != opr::group) {
+                auto rslt = push_opr(opr::opr_of(oprs.top()), opds, nodes);
                 oprs.pop();
-                auto rslt = push_opr(pushed, opds);
                 if (!rslt)
                     return std::unexpected(rslt.error());
             }
             if (!oprs.size())
                 return std::unexpected(error::couldnt_find_open_brace);
             oprs.pop();
-            is_node = false;
-        } else if (tf::ptf::is_special_close_brace(expr[i])) {
+            is_node = true;
+        } else if (tok.kind == token_kind::special_close_brace) {
             return std::unexpected(error::couldnt_find_open_brace);
+        } else if (tf::ptf::is_quote(expr[tok.offset])) {
+            return std::unexpected(error::couldnt_read_string_literal);
+        } else if (scan::is(expr[tok.offset], scan::kinds::digit)) {
+            return std::unexpected(error::couldnt_read_num_literal);
         } else {
             return std::unexpected(error::incorrect_char);
         }
     }
     while (oprs.size()) {
-        if (std::holds_alternative<char>(oprs.top()))
+        if (oprs.top() == opr::group)
             return std::unexpected(error::couldnt_find_close_brace);
-        opr::opr pushed = std::get<opr::opr>(oprs.top());
+        auto rslt = push_opr(opr::opr_of(oprs.top()), opds, nodes);
         oprs.pop();
-        auto rslt = push_opr(pushed, opds);
         if (!rslt)
             return std::unexpected(rslt.error());
     }
+    // An empty text or one of semicolons only
+    if (opds.empty())
+        return std::unexpected(error::couldnt_find_operand);
     if (opds.size() > 1)
         return std::unexpected(error::couldnt_find_operator);
-    return ftree::ftree(std::move(opds.top()));
+    return ftree::ftree(std::move(nodes), opds.top(), std::move(text));
+}
+
+pf::parse_rslt parse_exp(trims::ex_trim_str expr) {
+    return _parse_exp(expr);
+}
+
+pf::parse_rslt parse_exp(trims::mapped_ex_trim_str expr) {
+    return _parse_exp(expr);
+}
+
+pf::parse_rslt parse_exp(trims::view_ex_trim_str expr) {
+    return _parse_exp(expr);
+}
+
+pf::parse_rslt parse_exp(trims::mapped_span_ex_trim_str expr) {
+    return _parse_exp(expr);
+}
+
+pf::parse_rslt parse_exp(trims::view_span_ex_trim_str expr) {
+    return _parse_exp(expr);
+}
+
+pf::parse_rslt parse_exp(std::string_view expr) {
+    std::vector<tf::index_t> newlines;
+    std::deque<tf::index_t> saved;
+    std::deque<trims::extracted_span> extracted;
+    return parse_exp(trims::view_span_ex_trim_str(expr, newlines, saved, extracted));
+}
+
+
+// The flat tree copies the leaves, the nodes and their text are dropped with the tree, it is made of
+template<class ExTrimStr>
+pf::flat_rslt _parse_exp_flat(ExTrimStr& expr) {
+    auto tree = _parse_exp(expr);
+    if (!tree)
+        return std::unexpected(tree.error());
+    return ftree::flat_ftree(*tree);
+}
+
+pf::flat_rslt parse_exp_flat(trims::ex_trim_str expr) {
+    return _parse_exp_flat(expr);
+}
+
+pf::flat_rslt parse_exp_flat(trims::mapped_ex_trim_str expr) {
+    return _parse_exp_flat(expr);
+}
+
+pf::flat_rslt parse_exp_flat(trims::view_ex_trim_str expr) {
+    return _parse_exp_flat(expr);
+}
+
+pf::flat_rslt parse_exp_flat(trims::mapped_span_ex_trim_str expr) {
+    return _parse_exp_flat(expr);
+}
+
+pf::flat_rslt parse_exp_flat(trims::view_span_ex_trim_str expr) {
+    return _parse_exp_flat(expr);
+}
+
+pf::flat_rslt parse_exp_flat(std::string_view expr) {
+    std::vector<tf::index_t> newlines;
+    std::deque<tf::index_t> saved;
+    std::deque<trims::extracted_span> extracted;
+    return parse_exp_flat(trims::view_span_ex_trim_str(expr, newlines, saved, extracted));
 }
 
 }
@@ -0,0 +1,234 @@
+#include <optional>
+
+#include "include/lexer.h"
+#include "include/parse_exp.h"
+
+namespace parse_exp {
+
+namespace tn = ftree::_tree_node;
+
+// Precedence climbing over the token stream, with the keys of the operator table: what comes after an operator
+// belongs to its right operand, while it has a higher rhs_key than the operator's lhs_key. Each node is laid out
+// once, when both of its operands are. Operators and groups, that wait for an operand, are kept on a stack
+// instead of the native one, so nesting is bounded by memory only
+template<class ExTrimStr>
+class _pratt {
+private:
+    using node_rslt = std::expected<ftree::node_index, error>;
+
+    // Group, prefix operator or infix operator with its left operand, that waits for the operand being parsed.
+    // min_key is the one of the expression around it
+    struct _pending {
+        opr::opr_id id;
+        uint8_t min_key;
+        ftree::node_index lhs;
+    };
+
+    ExTrimStr& _expr;
+    lexer::token_stream<ExTrimStr> _tokens;
+    ftree::node_arena _nodes;
+    // Text of leaves, that the source doesnt keep, is moved here and handed to the tree
+    trims::text_arena _text;
+    std::optional<scan::bracket_index> _brackets;
+
+    tf::trim_fn_rslt _find_close(tf::index_t open) {
+        auto rslt = _brackets ? tf::trim_until_match(_expr, open, *_brackets) : tf::trim_until_close(_expr, open);
+        if (!rslt)
+            return rslt;
+        return *rslt - 1;
+    }
+
+    ftree::node_index _leaf(tn::leaf_type tp, tf::index_t offset, tf::index_t length) {
+        return _nodes.add(ftree::arena_node::leaf(tp, _expr.pin(offset, length, _text)));
+    }
+    error _incorrect(const lexer::token& tok) const {
+        if (tf::ptf::is_quote(_expr[tok.offset]))
+            return error::couldnt_read_string_literal;
+        return scan::is(_expr[tok.offset], scan::kinds::digit) ? error::couldnt_read_num_literal : error::incorrect_char;
+    }
+    bool _is_ways(ftree::node_index node) const noexcept {
+        return _nodes[node].kind == ftree::node_kind::ways;
+    }
+
+    // Same checks as push_opr, a piece of a ternary operator is only an operand of its other piece
+    node_rslt _apply(opr::opr_id id, ftree::node_index lhs, ftree::node_index rhs = 0) {
+        opr::opr _opr = opr::opr_of(id);
+        if (_is_ways(lhs))
+            return std::unexpected(error::piece_of_ternary_opr);
+        if (std::holds_alternative<opr::unary_opr>(_opr))
+            return _nodes.add(ftree::arena_node::unary(std::get<opr::unary_opr>(_opr), lhs));
+        if (std::holds_alternative<opr::binary_opr>(_opr)) {
+            if (_is_ways(rhs))
+                return std::unexpected(error::piece_of_ternary_opr);
+            return _nodes.add(ftree::arena_node::binary(std::get<opr::binary_opr>(_opr), lhs, rhs));
+        }
+        if (std::get<opr::ternary_opr>(_opr) == opr::ternary_opr::ways) {
+            if (_is_ways(rhs))
+                return std::unexpected(error::piece_of_ternary_opr);
+            return _nodes.add(ftree::arena_node::ways(lhs, rhs));
+        }
+        if (!_is_ways(rhs))
+            return std::unexpected(error::piece_of_ternary_opr);
+        return _nodes.add(ftree::arena_node::condition(lhs, rhs));
+    }
+
+    // Operand at the start of an expression. Groups and prefix operators before it are pending, until it is parsed
+    node_rslt _operand(pf::stack<_pending>& pending, uint8_t& min_key) {
+        using lexer::token_kind;
+        for (;;) {
+            lexer::token tok = _tokens.next();
+            if (tok.kind == token_kind::num_literal)
+                return _leaf(tn::leaf_type::num_literal, tok.offset, tok.length);
+            if (tok.kind == token_kind::str_literal)
+                return _leaf(tn::leaf_type::str_literal, tok.offset, tok.length);
+            if (tok.kind == token_kind::ident)
+                return _leaf(tn::leaf_type::var, tok.offset, tok.length);
+            if (tok.kind == token_kind::open_brace) {
+                if (_expr[tok.offset] != '(')
+                    return std::unexpected(error::couldnt_find_func_ptr);
+                pending.push({ opr::group, min_key, 0 });
+                min_key = 0;
+            } else if (tok.kind == token_kind::opr) {
+                opr::opr_id id = opr::opr_table[tok.opr].prefix;
+                if (id == opr::no_opr)
+                    return std::unexpected(error::couldnt_find_operand);
+                pending.push({ id, min_key, 0 });
+                min_key = opr::opr_table[id].lhs_key + 1;
+            } else if (tok.kind == token_kind::special_open_brace) {
+                return std::unexpected(error::couldnt_find_token);
+            } else if (tok.kind == token_kind::special_close_brace) {
+                return std::unexpected(error::couldnt_find_open_brace);
+            } else if (tok.kind == token_kind::incorrect) {
+                return std::unexpected(_incorrect(tok));
+            } else {
+                return std::unexpected(error::couldnt_find_operand);
+            }
+        }
+    }
+
+    // The innermost pending piece gets the operand, that ends here
+    node_rslt _complete(pf::stack<_pending>& pending, uint8_t& min_key, ftree::node_index opd) {
+        _pending top = pending.top();
+        pending.pop();
+        min_key = top.min_key;
+        if (top.id != opr::group)
+            return opr::opr_table[top.id].arity == 1 ? _apply(top.id, opd) : _apply(top.id, top.lhs, opd);
+        if (_tokens.peek().kind != lexer::token_kind::close_brace)
+            return std::unexpected(error::couldnt_find_close_brace);
+        _tokens.next();
+        return opd;
+    }
+
+    // Calls and constructor braces are applied to the operand right before them, as soon as they come
+    node_rslt _expression() {
+        using lexer::token_kind;
+        pf::stack<_pending> pending;
+        uint8_t min_key = 0;
+        auto lhs = _operand(pending, min_key);
+        while (lhs) {
+            lexer::token tok = _tokens.peek();
+            if (tok.kind == token_kind::open_brace) {
+                const ftree::arena_node& node = _nodes[*lhs];
+                if (node.kind == ftree::node_kind::leaf && node.leaf_tp() != tn::leaf_type::var &&
+                        node.leaf_tp() != tn::leaf_type::ctor_call)
+                    return std::unexpected(error::semantics_inconsistency);
+                auto close = _find_close(tok.offset);
+                if (!close)
+                    return std::unexpected(error::couldnt_find_close_brace);
+                auto arg = _leaf(tn::leaf_type::func_arg, tok.offset + 1, *close - tok.offset - 1);
+                _tokens.skip_to(*close + 1);
+                lhs = _nodes.add(ftree::arena_node::binary(opr::binary_opr::func_call, *lhs, arg));
+                continue;
+            } else if (tok.kind == token_kind::special_open_brace) {
+                ftree::arena_node& node = _nodes[*lhs];
+                if (node.kind != ftree::node_kind::leaf || node.leaf_tp() != tn::leaf_type::var)
+                    return std::unexpected(error::couldnt_find_token);
+                auto close = _find_close(tok.offset);
+                if (!close)
+                    return std::unexpected(error::couldnt_find_close_brace);
+                // The name leaf becomes the ctor leaf in place
+                node = ftree::arena_node::leaf(tn::leaf_type::ctor_call,
+                    _text.keep(node.expr(), _expr.substr(tok.offset, *close + 1 - tok.offset)));
+                _tokens.skip_to(*close + 1);
+                continue;
+            } else if (tok.kind == token_kind::opr) {
+                opr::opr_id id = opr::opr_table[tok.opr].infix;
+                if (id == opr::no_opr)
+                    return std::unexpected(error::couldnt_find_operator);
+                const opr::opr_info& info = opr::opr_table[id];
+                if (info.rhs_key >= min_key) {
+                    _tokens.next();
+                    if (info.arity == 1) {
+                        lhs = _apply(id, *lhs);
+                    } else {
+                        // Its right operand comes next, with what binds tighter than the operator
+                        pending.push({ id, min_key, *lhs });
+                        min_key = info.lhs_key + 1;
+                        lhs = _operand(pending, min_key);
+                    }
+                    continue;
+                }
+            } else if (tok.kind == token_kind::special_close_brace) {
+                return std::unexpected(error::couldnt_find_open_brace);
+            } else if (tok.kind == token_kind::incorrect) {
+                return std::unexpected(_incorrect(tok));
+            }
+            if (pending.empty())
+                break;
+            lhs = _complete(pending, min_key, *lhs);
+        }
+        return lhs;
+    }
+public:
+    _pratt(ExTrimStr& expr) : _expr(expr), _tokens(expr) {
+        if (auto resident = expr.window(0); !resident.begin() && resident.end() == expr.size())
+            _brackets.emplace(resident.data(0), resident.end());
+    }
+
+    pf::parse_rslt parse() {
+        using lexer::token_kind;
+        auto root = _expression();
+        if (!root)
+            return std::unexpected(root.error());
+        if (_tokens.peek().kind == token_kind::semicolon) {
+            while (_tokens.peek().kind == token_kind::semicolon)
+                _tokens.next();
+            if (_tokens.peek().kind != token_kind::end)
+                return std::unexpected(error::text_isnt_expr);
+        } else if (_tokens.peek().kind == token_kind::close_brace) {
+            return std::unexpected(error::couldnt_find_open_brace);
+        } else if (_tokens.peek().kind != token_kind::end) {
+            return std::unexpected(error::couldnt_find_operator);
+        }
+        return ftree::ftree(std::move(_nodes), *root, std::move(_text));
+    }
+};
+
+pf::parse_rslt parse_exp_pratt(trims::ex_trim_str expr) {
+    return _pratt(expr).parse();
+}
+
+pf::parse_rslt parse_exp_pratt(trims::mapped_ex_trim_str expr) {
+    return _pratt(expr).parse();
+}
+
+pf::parse_rslt parse_exp_pratt(trims::view_ex_trim_str expr) {
+    return _pratt(expr).parse();
+}
+
+pf::parse_rslt parse_exp_pratt(trims::mapped_span_ex_trim_str expr) {
+    return _pratt(expr).parse();
+}
+
+pf::parse_rslt parse_exp_pratt(trims::view_span_ex_trim_str expr) {
+    return _pratt(expr).parse();
+}
+
+pf::parse_rslt parse_exp_pratt(std::string_view expr) {
+    std::vector<tf::index_t> newlines;
+    std::deque<tf::index_t> saved;
+    std::deque<trims::extracted_span> extracted;
+    return parse_exp_pratt(trims::view_span_ex_trim_str(expr, newlines, saved, extracted));
+}
+
+}
@@ -5,6 +5,10 @@
 #include <filesystem>
 #include <vector>
 #include <functional>
+#include <string_view>
+#include <utility>
+#include <memory>
+#include <span>
 
 
 namespace io {
@@ -15,6 +19,7 @@ enum class error {
     file_doesnt_exist, couldnt_open_file,
     couldnt_read_file, couldnt_write_file,
     couldnt_get_file_size, couldnt_navigate_file,
+    couldnt_map_file,
 };
 
 std::string get_error_message(error code);
@@ -26,6 +31,67 @@ inline void return_to_begin_unsafe(std::istream& stream) noexcept {
     stream.seekg(0);
 }
 
+// Owned POSIX file descriptor, closed on destruction. Without POSIX none can be opened,
+// open_fd_ro fails and a stream source is to be used instead
+class file_desc {
+private:
+    int _fd;
+public:
+    file_desc() noexcept : _fd(-1) {}
+    explicit file_desc(int fd) noexcept : _fd(fd) {}
+    file_desc(const file_desc&) = delete;
+    file_desc(file_desc&& other) noexcept : _fd(std::exchange(other._fd, -1)) {}
+    file_desc& operator=(const file_desc&) = delete;
+    file_desc& operator=(file_desc&& other) noexcept;
+    ~file_desc();
+
+    int get() const noexcept { return _fd; }
+    explicit operator bool() const noexcept { return _fd != -1; }
+};
+
+std::expected<file_desc, error> open_fd_ro(const fs::path& file) noexcept;
+
+std::expected<uint64_t, error> get_file_size(const file_desc& fd) noexcept;
+
+// Reads up to n bytes at offset, short only at the end of file, file position isnt used or changed
+std::expected<size_t, error> pread_bytes(const file_desc& fd, uint64_t offset, uint8_t* buf, size_t n) noexcept;
+
+// Fills bufs one after another with bytes from offset, batched into as few syscalls as possible
+std::expected<size_t, error> 
+preadv_bytes(const file_desc& fd, uint64_t offset, std::span<const std::span<uint8_t>> bufs) noexcept;
+
+struct aligned_deleter {
+    void operator()(uint8_t* buf) const noexcept;
+};
+using aligned_buffer = std::unique_ptr<uint8_t[], aligned_deleter>;
+
+// Buffer aligned for direct io, empty on allocation failure
+aligned_buffer make_aligned_buffer(size_t n, size_t alignment = 4096) noexcept;
+
+// Read-only view of a whole file mapped into memory, unmapped on destruction
+class mapped_file {
+private:
+    const char* _data;
+    uint64_t _size;
+public:
+    mapped_file() noexcept : _data(nullptr), _size(0) {}
+    mapped_file(const char* data, uint64_t size) noexcept : _data(data), _size(size) {}
+    mapped_file(const mapped_file&) = delete;
+    mapped_file(mapped_file&& other) noexcept 
+        : _data(std::exchange(other._data, nullptr)), _size(std::exchange(other._size, 0)) {}
+    mapped_file& operator=(const mapped_file&) = delete;
+    mapped_file& operator=(mapped_file&& other) noexcept;
+    ~mapped_file();
+
+    const char* data() const noexcept { return _data; }
+    uint64_t size() const noexcept { return _size; }
+    std::string_view view() const noexcept { return { _data, _size }; }
+};
+
+// Maps file with sequential read-ahead hints, views into it live as long as the mapping.
+// Without mmap the file is read into memory as a whole
+std::expected<mapped_file, error> map_file_ro(const fs::path& file) noexcept;
+
 std::expected<void, io::error> return_to_begin(std::istream& stream) noexcept;
 
 std::expected<uint64_t, error> 
@@ -42,6 +108,10 @@ read_bytes(std::istream& in, uint64_t filesize, size_t max_bytes = 1024) noexcep
 std::expected<size_t, error> 
 read_bytes(std::istream& in, uint64_t filesize, uint8_t* buf, size_t max_bytes = 1024) noexcept;
 
+// For streams of unknown size: blocks for the first byte only, then takes what is already buffered.
+// A stream without a buffer, like std::cin synced with stdio, gives one byte per call then. 0 means eof
+std::expected<size_t, error> read_some(std::istream& in, uint8_t* buf, size_t max_bytes = 1024) noexcept;
+
 
 std::expected<std::ofstream, error> open_file_wb(const fs::path& file) noexcept;
 
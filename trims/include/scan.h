@@ -0,0 +1,201 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#include "trims_alloc.h"
+
+
+namespace scan {
+
+// Set of bytes as a 256-bit mask. Also keeps the low nibble lookup used by the vector kernels:
+// bit h of lo[l] is set when byte (h << 4 | l) belongs to the class, for bytes below 0x80
+struct char_class {
+    std::array<uint64_t, 4> bits {};
+    std::array<uint8_t, 16> lo {};
+    bool high = false;
+
+    constexpr bool test(unsigned char c) const noexcept { return bits[c >> 6] >> (c & 63) & 1; }
+    constexpr char_class& set(unsigned char c) noexcept {
+        bits[c >> 6] |= uint64_t(1) << (c & 63);
+        if (c < 0x80)
+            lo[c & 15] |= uint8_t(1) << (c >> 4);
+        else
+            high = true;
+        return *this;
+    }
+
+    static constexpr char_class of(std::string_view chars) noexcept {
+        char_class cls;
+        for (char c : chars)
+            cls.set(c);
+        return cls;
+    }
+    static constexpr char_class range(char from, char to) noexcept {
+        char_class cls;
+        for (int c = static_cast<unsigned char>(from); c <= static_cast<unsigned char>(to); ++c)
+            cls.set(c);
+        return cls;
+    }
+
+    constexpr char_class operator|(const char_class& other) const noexcept {
+        char_class cls;
+        for (int c = 0; c < 256; ++c) {
+            if (test(c) || other.test(c))
+                cls.set(c);
+        }
+        return cls;
+    }
+    constexpr char_class operator&(const char_class& other) const noexcept {
+        char_class cls;
+        for (int c = 0; c < 256; ++c) {
+            if (test(c) && other.test(c))
+                cls.set(c);
+        }
+        return cls;
+    }
+    constexpr char_class operator~() const noexcept {
+        char_class cls;
+        for (int c = 0; c < 256; ++c) {
+            if (!test(c))
+                cls.set(c);
+        }
+        return cls;
+    }
+};
+
+namespace classes {
+    constexpr char_class space = char_class::of(" \t\n\v\f\r");
+    constexpr char_class digit = char_class::range('0', '9');
+    constexpr char_class lower = char_class::range('a', 'z');
+    constexpr char_class upper = char_class::range('A', 'Z');
+    constexpr char_class alpha = lower | upper;
+    constexpr char_class alnum = alpha | digit;
+    constexpr char_class ident = alnum | char_class::of("_");
+    constexpr char_class linebreak = char_class::of("\n");
+}
+
+// Every byte's class bits in one table, so that a predicate is a single load and mask
+namespace kinds {
+    enum : uint16_t {
+        space = 1 << 0, digit = 1 << 1, alpha = 1 << 2, underscore = 1 << 3,
+        linebreak = 1 << 4, semicolon = 1 << 5, colon = 1 << 6, quest_mark = 1 << 7,
+        quote = 1 << 8, open_brace = 1 << 9, close_brace = 1 << 10,
+        special_open_brace = 1 << 11, special_close_brace = 1 << 12,
+
+        alnum = alpha | digit, ident = alnum | underscore,
+    };
+}
+
+struct kind_spec {
+    uint16_t kind;
+    char_class cls;
+};
+
+inline constexpr kind_spec kind_specs[] = {
+    { kinds::space, classes::space },
+    { kinds::digit, classes::digit },
+    { kinds::alpha, classes::alpha },
+    { kinds::underscore, char_class::of("_") },
+    { kinds::linebreak, classes::linebreak },
+    { kinds::semicolon, char_class::of(";") },
+    { kinds::colon, char_class::of(":") },
+    { kinds::quest_mark, char_class::of("?") },
+    { kinds::quote, char_class::of("\"'") },
+    { kinds::open_brace, char_class::of("([") },
+    { kinds::close_brace, char_class::of(")") },
+    { kinds::special_open_brace, char_class::of("{") },
+    { kinds::special_close_brace, char_class::of("]}") },
+};
+
+inline constexpr std::array<uint16_t, 256> kind_table = [] {
+    std::array<uint16_t, 256> table {};
+    for (const kind_spec& spec : kind_specs) {
+        for (int c = 0; c < 256; ++c) {
+            if (spec.cls.test(c))
+                table[c] |= spec.kind;
+        }
+    }
+    return table;
+}();
+
+constexpr bool is(unsigned char c, uint16_t kind) noexcept {
+    return kind_table[c] & kind;
+}
+
+namespace _reference {
+    // What <cctype> answers in the "C" locale, which the table has to agree with
+    constexpr bool isspace(int c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+    constexpr bool isdigit(int c) { return c >= '0' && c <= '9'; }
+    constexpr bool isalpha(int c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+
+    constexpr bool matches() {
+        for (int c = 0; c < 256; ++c) {
+            if (is(c, kinds::space) != isspace(c) || is(c, kinds::digit) != isdigit(c) ||
+                is(c, kinds::alpha) != isalpha(c) || is(c, kinds::alnum) != (isalpha(c) || isdigit(c)))
+                return false;
+        }
+        return true;
+    }
+}
+
+static_assert(_reference::matches(), "kind_table disagrees with <cctype> classification");
+
+// Length of the common prefix of a[0, n) and b[0, n), compared 8 bytes at a time
+inline size_t mismatch(const char* a, const char* b, size_t n) noexcept {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t x, y;
+        std::memcpy(&x, a + i, 8), std::memcpy(&y, b + i, 8);
+        if (x != y) {
+            if constexpr (std::endian::native == std::endian::little)
+                return i + std::countr_zero(x ^ y) / 8;
+            else
+                return i + std::countl_zero(x ^ y) / 8;
+        }
+    }
+    while (i < n && a[i] == b[i]) ++i;
+    return i;
+}
+
+// Appends base + i + 1 for every '\n' at data[i], that is positions where next lines start
+void find_newlines(const char* data, size_t n, uint64_t base, std::vector<uint64_t>& out);
+
+// Index of the end of a string literal body in data[0, n): the first quote, that isnt escaped by an odd run
+// of backslashes, or the first newline, n if there is neither. escaped tells whether data[0] follows
+// an unpaired backslash and is updated for the byte after data[n - 1], so that a literal can be scanned in parts
+size_t find_literal_end(const char* data, size_t n, bool& escaped) noexcept;
+
+// Matching close of every open bracket of ()[]{} in a text, built in one pass, that skips string literals.
+// Open brackets are kept as a bitmap with ranks per word, so that a lookup is a popcount and a load
+class bracket_index {
+public:
+    static constexpr uint64_t npos = -1;
+private:
+    trims::counted_vector<uint64_t> _opens;
+    trims::counted_vector<uint64_t> _ranks;
+    trims::counted_vector<uint64_t> _closes;
+public:
+    bracket_index() = default;
+    bracket_index(const char* data, size_t n);
+
+    // Position of the bracket closing the one at pos, npos if pos isnt an open bracket or it isnt closed
+    uint64_t match(uint64_t pos) const noexcept {
+        uint64_t word = pos >> 6, bit = uint64_t(1) << (pos & 63);
+        if (word >= _opens.size() || !(_opens[word] & bit))
+            return npos;
+        return _closes[_ranks[word] + std::popcount(_opens[word] & (bit - 1))];
+    }
+};
+
+// Index of the first byte of data[0, n) that is (not) in cls, n if there is none.
+// Picks an AVX2 or SSSE3 kernel by the running cpu, with a scalar fallback
+size_t find_first_of(const char* data, size_t n, const char_class& cls) noexcept;
+size_t find_first_not_of(const char* data, size_t n, const char_class& cls) noexcept;
+
+}
@@ -2,18 +2,30 @@
 
 #include <expected>
 #include <istream>
+#include <iostream>
 #include <memory>
 #include <string>
 #include <string_view>
 #include <deque>
 #include <stdexcept>
+#include <exception>
 #include <concepts>
 #include <type_traits>
 #include <variant>
+#include <tuple>
 #include <array>
 #include <utility>
+#include <algorithm>
+#include <bit>
+#include <span>
+#include <atomic>
+#include <thread>
+#include <optional>
+#include <vector>
 
 #include "io.h"
+#include "scan.h"
+#include "trims_alloc.h"
 
 
 namespace tf {
@@ -21,6 +33,42 @@ namespace tf {
 using index_t = uint64_t;    
 using trim_fn_rslt = std::expected<index_t, index_t>;
 
+// Resident contiguous bytes [begin, end) of a trim string of given size, read without virtual calls.
+// Reads outside of them are remembered, so that a result depending on them can be recomputed on the trim string,
+// and the size drops to 0 after such a read, so that any loop over the span ends right away.
+// data points at the byte at begin, it is null for an empty span
+class trim_span {
+private:
+    const char* _data;
+    index_t _begin, _end, _size;
+    mutable bool _missed;
+public:
+    trim_span(const char* data, index_t begin, index_t end, index_t size) noexcept
+        : _data(data), _begin(begin), _end(end), _size(size), _missed(false) {}
+
+    index_t begin() const noexcept { return _begin; }
+    index_t end() const noexcept { return _end; }
+    const char* data(index_t pos) const noexcept { return _data + (pos - _begin); }
+    bool missed() const noexcept { return _missed; }
+    void miss() const noexcept { _missed = true; }
+
+    index_t size() const noexcept { return _missed ? 0 : _size; }
+    char operator[](index_t pos) const noexcept {
+        if (pos - _begin >= _end - _begin) [[unlikely]]
+            return _missed = true, '\0';
+        return _data[pos - _begin];
+    }
+    char at(index_t pos) const noexcept { return (*this)[pos]; }
+    std::string_view substr(index_t pos, index_t n) const noexcept {
+        n = std::min(n, _size - std::min(pos, _size));
+        if (pos < _begin || pos + n > _end) [[unlikely]] {
+            _missed = true;
+            return {};
+        }
+        return { _data + (pos - _begin), n };
+    }
+};
+
 }
 
 namespace trims {
@@ -28,98 +76,479 @@ namespace trims {
 using tf::index_t;
 
 enum class count_lines { no, yes };
-template<count_lines> class _trim_str_buf {};
+enum class buf_src { stream, mapped, view, prefetch, fd, pipe };
+template<count_lines, buf_src = buf_src::stream> class _trim_str_buf {};
 
-template<>
-class _trim_str_buf<count_lines::no> {
+// Stable storage for pieces of text, that must outlive the window they were read from. Blocks are never moved
+// or freed before the arena is, so views into it stay valid as long as it lives, moving it included
+class text_arena {
 protected:
-    std::istream* _src;
-    index_t _size;
-    bool _eos;
-    std::string _data;
+    static constexpr index_t block_size = 4096;
+    counted_vector<std::unique_ptr<char[]>> _blocks;
+    char* _free;
+    index_t _left;
+public:
+    text_arena() noexcept : _free(nullptr), _left(0) {}
+
+    char* allocate(index_t n) {
+        if (n > _left) {
+            auto& block = _blocks.emplace_back(make_counted_for_overwrite<char[]>(std::max(n, block_size)));
+            if (n >= block_size)
+                return block.get();
+            _free = block.get(), _left = block_size;
+        }
+        return _left -= n, std::exchange(_free, _free + n);
+    }
+    std::string_view keep(std::string_view text) {
+        char* kept = allocate(text.size());
+        return std::copy(text.begin(), text.end(), kept), std::string_view(kept, text.size());
+    }
+    // Two pieces as one text
+    std::string_view keep(std::string_view first, std::string_view second) {
+        char* kept = allocate(first.size() + second.size());
+        std::copy(second.begin(), second.end(), std::copy(first.begin(), first.end(), kept));
+        return std::string_view(kept, first.size() + second.size());
+    }
+};
+
+// Power-of-two ring holding bytes [start, end) of a source. Dropping bytes from the front is free,
+// bytes are only moved when the ring grows or when a view must be made contiguous
+class _ring_window {
+protected:
+    std::unique_ptr<char[]> _ring;
+    index_t _mask, _base;
     index_t _start, _end;
+    index_t _moved;
+
+    void _relocate(index_t capacity) {
+        auto ring = make_counted<char[]>(capacity);
+        for (index_t pos = _start; pos < _end; ) {
+            index_t off = (pos - _base) & _mask, n = std::min(_end - pos, _mask + 1 - off);
+            std::copy_n(&_ring[off], n, &ring[pos - _start]);
+            pos += n;
+        }
+        _moved += _end - _start;
+        _ring = std::move(ring), _mask = capacity - 1, _base = _start;
+    }
 public:
-    _trim_str_buf(std::istream* src) : _src(src), _eos(false), _start(0), _end(0) {
-        auto size = io::get_file_size(*src);
-        if (!size)
-            throw std::runtime_error(io::get_error_message(size.error()));
-        _size = *size;
+    _ring_window(index_t capacity = 16384) 
+        : _ring(make_counted<char[]>(capacity)), _mask(capacity - 1), _base(0), _start(0), _end(0), _moved(0) {}
+
+    index_t start() const noexcept { return _start; }
+    index_t end() const noexcept { return _end; }
+    index_t capacity() const noexcept { return _mask + 1; }
+    // Bytes copied inside the window, reading into it isnt counted. Over end() it is the bytes copied per input byte
+    index_t moved() const noexcept { return _moved; }
+
+    void set_start(index_t pos) noexcept { 
+        if (pos > _start) 
+            _start = std::min(pos, _end); 
     }
+    // Contiguous free space right after end, at most n bytes
+    std::span<char> tail(index_t n) {
+        if (capacity() - (_end - _start) < n)
+            _relocate(std::bit_ceil(2 * (_end - _start + n)));
+        index_t off = (_end - _base) & _mask;
+        return { &_ring[off], std::min(n, capacity() - off) };
+    }
+    // Same space split at the wrap point, so that it can be filled at once
+    std::array<std::span<char>, 2> tails(index_t n) {
+        auto first = tail(n);
+        return { first, std::span<char>(&_ring[0], n - first.size()) };
+    }
+    void commit(index_t n) noexcept { _end += n; }
 
-    index_t size() const noexcept { return _size; }
-    void set_start(index_t pos) {
-        constexpr index_t min_distance = 1024;
+    // Bytes [pos, pos + n) as up to two contiguous pieces, without moving anything
+    std::array<std::string_view, 2> pieces(index_t pos, index_t n) const noexcept {
+        index_t off = (pos - _base) & _mask, first = std::min(n, capacity() - off);
+        return { std::string_view(&_ring[off], first), std::string_view(&_ring[0], n - first) };
+    }
+
+    char operator[](index_t pos) const noexcept { return _ring[(pos - _base) & _mask]; }
+    std::string_view view(index_t pos, index_t n) {
+        index_t off = (pos - _base) & _mask;
+        if (off + n > capacity())
+            _relocate(2 * (_end - _start) > capacity() ? 2 * capacity() : capacity()), off = pos - _base;
+        return { &_ring[off], n };
+    }
+};
 
-        if (pos - _start < min_distance)
-            return;
-        _start = pos, _data = std::string(_data.begin() + (pos - _start), _data.end());
+// Sources read piece by piece into a ring window, Buf provides underflow() appending to _data
+template<class Buf>
+class _windowed_trim_str_buf {
+protected:
+    index_t _size;
+    bool _eos;
+    _ring_window _data;
+    std::vector<index_t>* _line_index;
+
+    _windowed_trim_str_buf(index_t size) : _size(size), _eos(!size), _line_index(nullptr) {}
+    void _underflow() { static_cast<Buf*>(this)->underflow(); }
+    // Makes n bytes written after end a part of the window, indexing their newlines once
+    void _commit(index_t n) {
+        if (_line_index) {
+            index_t pos = _data.end();
+            for (auto piece : _data.pieces(pos, n))
+                scan::find_newlines(piece.data(), piece.size(), pos, *_line_index), pos += piece.size();
+        }
+        _data.commit(n);
+    }
+public:
+    index_t size() const noexcept { return _size; }
+    index_t moved() const noexcept { return _data.moved(); }
+    // Contiguous piece of the window holding pos, the next piece is read in if there is nothing at pos
+    tf::trim_span window(index_t pos) {
+        if (pos >= _data.end() && !_eos)
+            _underflow();
+        if (pos < _data.start() || pos >= _data.end())
+            return tf::trim_span(nullptr, pos, pos, _size);
+        auto pieces = _data.pieces(_data.start(), _data.end() - _data.start());
+        index_t split = _data.start() + pieces[0].size();
+        if (pos < split)
+            return tf::trim_span(pieces[0].data(), _data.start(), split, _size);
+        return tf::trim_span(pieces[1].data(), split, _data.end(), _size);
+    }
+    void index_lines(std::vector<index_t>* index) noexcept { _line_index = index; }
+    void set_start(index_t pos) noexcept { _data.set_start(pos); }
+    char at(index_t pos) {
+        while (pos >= _data.end() && !_eos)
+            _underflow();
+        if (pos < _data.start() || pos >= _data.end())
+            throw std::out_of_range("trim_str_buf::at");
+        return _data[pos];
+    }
+    char operator[](index_t pos) {
+        while (pos >= _data.end() && !_eos)
+            _underflow();
+        return _data[pos];
+    }
+    std::string_view substr(index_t pos, index_t n) {
+        while (pos >= _data.end() && !_eos)
+            _underflow();
+        while (n != index_t(-1) && !_eos && _data.end() - pos < n)
+            _underflow();
+        if (pos < _data.start() || pos > _data.end())
+            throw std::out_of_range("trim_str_buf::substr");
+        return _data.view(pos, std::min(n, _data.end() - pos));
     }
+    // Bytes [pos, pos + n) copied into arena, as the window drops and moves them later
+    std::string_view pin(index_t pos, index_t n, text_arena& arena) {
+        while (pos >= _data.end() && !_eos)
+            _underflow();
+        while (!_eos && _data.end() - pos < n)
+            _underflow();
+        if (pos < _data.start() || pos > _data.end())
+            throw std::out_of_range("trim_str_buf::pin");
+        n = std::min(n, _data.end() - pos);
+        char* pinned = arena.allocate(n);
+        for (char* out = pinned; auto piece : _data.pieces(pos, n))
+            out = std::copy(piece.begin(), piece.end(), out);
+        return { pinned, n };
+    }
+};
+
+inline index_t _source_size(std::istream& src) {
+    auto size = io::get_file_size(src);
+    if (!size)
+        throw std::runtime_error(io::get_error_message(size.error()));
+    return *size;
+}
+
+inline index_t _source_size(const io::file_desc& src) {
+    auto size = io::get_file_size(src);
+    if (!size)
+        throw std::runtime_error(io::get_error_message(size.error()));
+    return *size;
+}
+
+template<>
+class _trim_str_buf<count_lines::no, buf_src::stream> 
+    : public _windowed_trim_str_buf<_trim_str_buf<count_lines::no, buf_src::stream>> {
+public:
+    using source_t = std::istream&;
+protected:
+    std::istream* _src;
+public:
+    _trim_str_buf(source_t src) : _windowed_trim_str_buf(_source_size(src)), _src(&src) {}
+
     void underflow() {
         constexpr index_t read_chunk_size = 1024;
 
         if (_eos) return;
-        _data.reserve(_data.size() + read_chunk_size);
-        auto read = io::read_bytes(*_src, _size, read_chunk_size);
+        auto tail = _data.tail(read_chunk_size);
+        auto read = io::read_bytes(*_src, _size, reinterpret_cast<uint8_t*>(tail.data()), tail.size());
         if (!read)
             throw std::runtime_error(io::get_error_message(read.error()));
-        std::copy(read->begin(), read->end(), std::back_inserter(_data));
-        _end += read->size(), _eos = (read->size() != read_chunk_size);
+        _commit(*read), _eos = (_data.end() == _size || !*read);
+    }
+};
+
+// Non-seekable stream of unknown size. size() is the number of bytes read so far and reading goes on lazily,
+// so that checks like pos < size() hold for the furthest accessed position plus lookahead until eof is read.
+// An io error or a failed allocation makes size() step one byte past the data, so the next access rethrows it.
+// std::cin is unsynced from stdio, when it is the source, so that it buffers and a read takes what is there
+template<>
+class _trim_str_buf<count_lines::no, buf_src::pipe> 
+    : public _windowed_trim_str_buf<_trim_str_buf<count_lines::no, buf_src::pipe>> {
+public:
+    using source_t = std::istream&;
+    using base = _windowed_trim_str_buf<_trim_str_buf<count_lines::no, buf_src::pipe>>;
+    // Furthest any trim function looks past the position it has checked
+    static constexpr index_t lookahead = 8;
+protected:
+    std::istream* _src;
+    index_t _touched;
+    std::exception_ptr _err;
+
+    // Growing the ring may throw, so may a failed read. Either is kept for underflow to rethrow,
+    // as size() is called where nothing is expected to throw
+    void _fill() noexcept {
+        constexpr index_t read_chunk_size = 1024;
+
+        try {
+            auto tail = _data.tail(read_chunk_size);
+            auto read = io::read_some(*_src, reinterpret_cast<uint8_t*>(tail.data()), tail.size());
+            if (!read)
+                throw std::runtime_error(io::get_error_message(read.error()));
+            if (!*read)
+                _size = _data.end(), _eos = true;
+            else
+                _commit(*read);
+        } catch (...) {
+            _err = std::current_exception();
+        }
+    }
+public:
+    _trim_str_buf(source_t src) : base(-1), _src(&src), _touched(0) {
+        if (_src == &std::cin)
+            std::ios_base::sync_with_stdio(false);
+    }
+
+    index_t size() noexcept {
+        while (!_eos && !_err && _data.end() < _touched + lookahead)
+            _fill();
+        return _err ? _data.end() + 1 : _data.end();
+    }
+    void underflow() {
+        if (!_eos && !_err)
+            _fill();
+        if (_err)
+            std::rethrow_exception(_err);
     }
     char at(index_t pos) {
-        while (pos >= _end && !_eos)
-            underflow();
-        return _data.at(pos - _start);
+        _touched = std::max(_touched, pos + 1);
+        return base::at(pos);
     }
     char operator[](index_t pos) {
-        while (pos >= _end && !_eos)
-            underflow();
-        return _data[pos - _start];
+        _touched = std::max(_touched, pos + 1);
+        return base::operator[](pos);
     }
     std::string_view substr(index_t pos, index_t n) {
-        if (n != -1)
-            this->at(pos + n - 1);
-        return std::string_view(_data).substr(pos - _start, n);
+        if (n != index_t(-1))
+            _touched = std::max(_touched, pos + n);
+        return base::substr(pos, n);
+    }
+    std::string_view pin(index_t pos, index_t n, text_arena& arena) {
+        _touched = std::max(_touched, pos + n);
+        return base::pin(pos, n, arena);
     }
 };
 
+// Positional reads straight from a descriptor, both pieces of the ring's free space are filled by one syscall
 template<>
-class _trim_str_buf<count_lines::yes> : public _trim_str_buf<count_lines::no> {
+class _trim_str_buf<count_lines::no, buf_src::fd> 
+    : public _windowed_trim_str_buf<_trim_str_buf<count_lines::no, buf_src::fd>> {
 public:
-    using base = _trim_str_buf<count_lines::no>;
+    using source_t = const io::file_desc&;
 protected:
-    std::deque<index_t>* _newlines;
+    const io::file_desc* _src;
 public:
-    _trim_str_buf(std::istream* src, std::deque<index_t>* newlines) : base(src), _newlines(newlines) {
-        this->_newlines->push_back(0);
+    _trim_str_buf(source_t src) : _windowed_trim_str_buf(_source_size(src)), _src(&src) {}
+
+    void underflow() {
+        constexpr index_t read_chunk_size = 16384;
+
+        if (_eos) return;
+        auto tails = _data.tails(std::min(read_chunk_size, _size - _data.end()));
+        std::array<std::span<uint8_t>, 2> bufs = {
+            std::span(reinterpret_cast<uint8_t*>(tails[0].data()), tails[0].size()),
+            std::span(reinterpret_cast<uint8_t*>(tails[1].data()), tails[1].size())
+        };
+        auto read = io::preadv_bytes(*_src, _data.end(), bufs);
+        if (!read)
+            throw std::runtime_error(io::get_error_message(read.error()));
+        _commit(*read), _eos = (_data.end() == _size || !*read);
     }
-    
-    std::deque<index_t>* const& newlines() const noexcept { return _newlines; }
-    std::deque<index_t>* newlines(std::deque<index_t>& newlines) noexcept { 
-        return std::exchange(_newlines, &newlines); 
+};
+
+// Bounded single producer, single consumer queue of chunks, filled from a stream by a helper thread.
+// Producer blocks while all chunks are full, consumer blocks while all are empty
+class _prefetch_queue {
+public:
+    struct chunk {
+        std::unique_ptr<char[]> data;
+        index_t size;
+        bool last;
+        std::optional<io::error> err;
+    };
+protected:
+    counted_vector<chunk> _chunks;
+    index_t _chunk_size;
+    std::atomic<index_t> _head, _tail;
+    std::atomic<bool> _stop;
+    std::jthread _worker;
+
+    void _produce(std::istream* src, index_t size) {
+        for (index_t read_total = 0; ; ) {
+            index_t tail = _tail.load(std::memory_order_relaxed);
+            for (index_t head; tail - (head = _head.load(std::memory_order_acquire)) == _chunks.size(); )
+                _head.wait(head, std::memory_order_acquire);
+            if (_stop.load(std::memory_order_relaxed))
+                return;
+            chunk& c = _chunks[tail % _chunks.size()];
+            auto read = io::read_bytes(*src, size, reinterpret_cast<uint8_t*>(c.data.get()), _chunk_size);
+            c.err = read ? std::nullopt : std::optional(read.error());
+            c.size = read.value_or(0), read_total += c.size;
+            c.last = !read || !c.size || read_total == size;
+            _tail.store(tail + 1, std::memory_order_release), _tail.notify_one();
+            if (c.last)
+                return;
+        }
+    }
+public:
+    _prefetch_queue(std::istream* src, index_t size, index_t chunk_size, index_t chunks) 
+        : _chunks(chunks), _chunk_size(chunk_size), _head(0), _tail(0), _stop(false) {
+        for (auto& c : _chunks)
+            c.data = make_counted<char[]>(chunk_size);
+        _worker = std::jthread([this, src, size] { _produce(src, size); });
+    }
+    ~_prefetch_queue() {
+        _stop.store(true, std::memory_order_relaxed);
+        _head.fetch_add(1, std::memory_order_release), _head.notify_one();
     }
 
-    char at(index_t pos) {
-        while (pos >= _end && !_eos)
-            underflow();
-        if (_data.at(pos - _start) == '\n') {
-            auto it = std::lower_bound(_newlines->begin(), _newlines->end(), pos + 1);
-            if (it == _newlines->end() || *it != pos + 1)
-                _newlines->insert(it, pos + 1);
+    const chunk& front() const {
+        index_t head = _head.load(std::memory_order_relaxed);
+        for (index_t tail; (tail = _tail.load(std::memory_order_acquire)) == head; )
+            _tail.wait(tail, std::memory_order_acquire);
+        return _chunks[head % _chunks.size()];
+    }
+    void pop() {
+        _head.fetch_add(1, std::memory_order_release), _head.notify_one();
+    }
+};
+
+// Same window as the stream source, but reads are done ahead by a helper thread
+template<>
+class _trim_str_buf<count_lines::no, buf_src::prefetch> 
+    : public _windowed_trim_str_buf<_trim_str_buf<count_lines::no, buf_src::prefetch>> {
+public:
+    using source_t = std::istream&;
+    static constexpr index_t prefetch_chunk_size = 16384, prefetch_chunks = 8;
+protected:
+    std::unique_ptr<_prefetch_queue> _queue;
+public:
+    _trim_str_buf(source_t src) : _windowed_trim_str_buf(_source_size(src)) {
+        if (!_eos)
+            _queue = make_counted<_prefetch_queue>(&src, _size, prefetch_chunk_size, prefetch_chunks);
+    }
+
+    void underflow() {
+        if (_eos) return;
+        auto& chunk = _queue->front();
+        if (chunk.err)
+            throw std::runtime_error(io::get_error_message(*chunk.err));
+        for (index_t off = 0; off < chunk.size; ) {
+            auto tail = _data.tail(chunk.size - off);
+            std::copy_n(&chunk.data[off], tail.size(), tail.data());
+            _commit(tail.size()), off += tail.size();
         }
-        return _data[pos - _start];
+        _eos = chunk.last;
+        _queue->pop();
+        if (_eos)
+            _queue.reset();
     }
-    char operator[](index_t pos) {
-        while (pos >= _end && !_eos)
-            underflow();
-        if (_data[pos - _start] == '\n') {
-            auto it = std::lower_bound(_newlines->begin(), _newlines->end(), pos + 1);
-            if (it == _newlines->end() || *it != pos + 1)
-                _newlines->insert(it, pos + 1);
+};
+
+// Caller owned contiguous bytes, nothing is ever read or dropped, so views stay valid as long as the source
+template<>
+class _trim_str_buf<count_lines::no, buf_src::view> {
+public:
+    using source_t = std::string_view;
+protected:
+    std::string_view _data;
+public:
+    _trim_str_buf(source_t src) noexcept : _data(src) {}
+
+    std::string_view data() const noexcept { return _data; }
+    tf::trim_span window(index_t) const noexcept { return tf::trim_span(_data.data(), 0, _data.size(), _data.size()); }
+    index_t size() const noexcept { return _data.size(); }
+    void set_start(index_t) noexcept {}
+    void underflow() noexcept {}
+    char at(index_t pos) const { return _data.at(pos); }
+    char operator[](index_t pos) const noexcept { return _data[pos]; }
+    std::string_view substr(index_t pos, index_t n) const { return _data.substr(pos, n); }
+    // Nothing to copy, the view is as long lived as the source
+    std::string_view pin(index_t pos, index_t n, text_arena&) const { return _data.substr(pos, n); }
+};
+
+// Whole file is mapped, views stay valid for the life of the mapping
+template<>
+class _trim_str_buf<count_lines::no, buf_src::mapped> : public _trim_str_buf<count_lines::no, buf_src::view> {
+public:
+    using base = _trim_str_buf<count_lines::no, buf_src::view>;
+    using source_t = const io::mapped_file&;
+
+    _trim_str_buf(source_t src) noexcept : base(src.view()) {}
+};
+
+// Newlines are indexed once per ingested chunk for read sources, and on demand for contiguous ones,
+// so character access stays as is and lookups are binary searches over line starts
+template<buf_src Src>
+class _trim_str_buf<count_lines::yes, Src> : public _trim_str_buf<count_lines::no, Src> {
+public:
+    using base = _trim_str_buf<count_lines::no, Src>;
+    using typename base::source_t;
+    static constexpr bool contiguous = requires(const base& b) { b.data(); };
+protected:
+    std::vector<index_t>* _newlines;
+    mutable index_t _indexed;
+
+    void _attach() {
+        if constexpr (!contiguous)
+            this->index_lines(_newlines);
+    }
+    void _index_until(index_t pos) const {
+        if constexpr (contiguous) {
+            if (pos <= _indexed)
+                return;
+            pos = std::min<index_t>(pos, this->size());
+            scan::find_newlines(this->data().data() + _indexed, pos - _indexed, _indexed, *_newlines);
+            _indexed = pos;
         }
-        return _data[pos - _start];
     }
-    index_t linepos(size_t line) const { return (*_newlines)[line - 1]; } 
+public:
+    _trim_str_buf(source_t src, std::vector<index_t>* newlines) : base(src), _newlines(newlines), _indexed(0) {
+        this->_newlines->push_back(0);
+        _attach();
+    }
+    
+    std::vector<index_t>* const& newlines() const noexcept { return _newlines; }
+    std::vector<index_t>* newlines(std::vector<index_t>& newlines) noexcept { 
+        auto old = std::exchange(_newlines, &newlines); 
+        return _attach(), old;
+    }
+
+    index_t linepos(size_t line) const { 
+        if constexpr (contiguous) {
+            constexpr index_t step = 4096;
+            while (_newlines->size() < line && _indexed < this->size())
+                _index_until(_indexed + step);
+        }
+        return (*_newlines)[line - 1]; 
+    } 
     std::pair<size_t, size_t> linecol(index_t pos) const {
+        _index_until(pos);
         auto it = std::next(std::upper_bound(_newlines->begin(), _newlines->end(), pos), -1);
         return { std::distance(_newlines->begin(), it) + 1, pos - *it + 1 };
     }
@@ -136,20 +565,21 @@ struct trim_str_like {
     virtual bool err() const noexcept { return !ok(); }
 };
 
-template<count_lines CountLines>
+template<count_lines CountLines, buf_src Src = buf_src::stream>
 class _trim_str_base : public trim_str_like {
 public:
     static constexpr bool counts_lines = (CountLines == count_lines::yes);
+    using source_t = typename _trim_str_buf<CountLines, Src>::source_t;
 protected:
-    mutable _trim_str_buf<CountLines> _buf;
+    mutable _trim_str_buf<CountLines, Src> _buf;
     index_t _pos;
 public:
-    _trim_str_base(std::istream& src) requires(!counts_lines) : _buf(&src), _pos(0) {}
-    _trim_str_base(std::istream& src, std::deque<index_t>& newlines) requires(counts_lines) 
-        : _buf(&src, &newlines), _pos(0) {}
+    _trim_str_base(source_t src) requires(!counts_lines) : _buf(src), _pos(0) {}
+    _trim_str_base(source_t src, std::vector<index_t>& newlines) requires(counts_lines) 
+        : _buf(src, &newlines), _pos(0) {}
 
     auto& newlines() const noexcept requires(counts_lines) { return _buf.newlines(); }
-    auto newlines(std::deque<index_t>& newlines) noexcept requires(counts_lines) { 
+    auto newlines(std::vector<index_t>& newlines) noexcept requires(counts_lines) { 
         return _buf.newlines(newlines); 
     }
 
@@ -161,40 +591,48 @@ public:
     char at(index_t pos) const override { return _buf.at(pos); }
     char operator[](index_t pos) const override { return _buf[pos]; }
     std::string_view substr(index_t pos, index_t n) const override { return _buf.substr(pos, n); }
+    // View of [pos, pos + n), that stays valid after the trim string drops it, as long as the source or arena does
+    std::string_view pin(index_t pos, index_t n, text_arena& arena) const { return _buf.pin(pos, n, arena); }
+    tf::trim_span window(index_t pos) const { return _buf.window(pos); }
 
     bool exhausted() const noexcept override { return _pos >= _buf.size(); }
     bool ok() const noexcept override { return _pos != -1; }
 };
 
 enum class use_saves { no, yes };
-template<count_lines, use_saves> class _saving_trim_str_base {};
+template<count_lines, use_saves, buf_src = buf_src::stream> class _saving_trim_str_base {};
 
-template<count_lines CountLines>
-class _saving_trim_str_base<CountLines, use_saves::no> : public _trim_str_base<CountLines> {
+template<count_lines CountLines, buf_src Src>
+class _saving_trim_str_base<CountLines, use_saves::no, Src> : public _trim_str_base<CountLines, Src> {
 public:
-    using base = _trim_str_base<CountLines>;
+    using base = _trim_str_base<CountLines, Src>;
+    using typename base::source_t;
 protected:
-    void _upd_buf_start() { this->_buf.set_start(this->_pos); }
+    // First byte, that is still needed
+    index_t _held() const noexcept { return this->_pos; }
+    void _upd_buf_start() { this->_buf.set_start(_held()); }
 public:
-    _saving_trim_str_base(std::istream& src) requires(CountLines == count_lines::no) : base(src) {}
-    _saving_trim_str_base(std::istream& src, std::deque<index_t>& newlines) 
+    _saving_trim_str_base(source_t src) requires(CountLines == count_lines::no) : base(src) {}
+    _saving_trim_str_base(source_t src, std::vector<index_t>& newlines) 
         requires(CountLines == count_lines::yes) : base(src, newlines) {}
 };
 
-template<count_lines CountLines>
-class _saving_trim_str_base<CountLines, use_saves::yes> : public _trim_str_base<CountLines> {
+template<count_lines CountLines, buf_src Src>
+class _saving_trim_str_base<CountLines, use_saves::yes, Src> : public _trim_str_base<CountLines, Src> {
 public:
-    using base = _trim_str_base<CountLines>;
+    using base = _trim_str_base<CountLines, Src>;
+    using typename base::source_t;
 protected:
     std::deque<index_t>* _saved;
 
-    void _upd_buf_start() { 
-        this->_buf.set_start(this->_saved->size() ? std::min(this->_saved->front(), this->_pos) : this->_pos); 
+    index_t _held() const noexcept { 
+        return this->_saved->size() ? std::min(this->_saved->front(), this->_pos) : this->_pos; 
     }
+    void _upd_buf_start() { this->_buf.set_start(_held()); }
 public:
-    _saving_trim_str_base(std::istream& src, std::deque<index_t>& saved) requires(CountLines == count_lines::no)
+    _saving_trim_str_base(source_t src, std::deque<index_t>& saved) requires(CountLines == count_lines::no)
         : base(src), _saved(&saved) {}
-    _saving_trim_str_base(std::istream& src, std::deque<index_t>& newlines, std::deque<index_t>& saved) 
+    _saving_trim_str_base(source_t src, std::vector<index_t>& newlines, std::deque<index_t>& saved) 
         requires(CountLines == count_lines::yes) : base(src, newlines), _saved(&saved) {}
     
     std::deque<index_t>* const& saved() const noexcept { return _saved; }
@@ -221,10 +659,31 @@ namespace tags {
 
 using trims::trim_str_like;
 
+// Trim functions are written once for both, virtual trim strings and resident spans of them
+template<class S>
+concept trim_str_c = std::derived_from<S, trim_str_like> || std::same_as<S, trim_span>;
+
+template<class S, class... Args>
+using basic_trim_fn_t = trim_fn_rslt(*)(const S&, index_t, Args...);
+
 template<class... Args>
-using trim_fn_t = trim_fn_rslt(*)(const trim_str_like&, index_t, Args...);
+using trim_fn_t = basic_trim_fn_t<trim_str_like, Args...>;
 
 using trim_fn = trim_fn_t<>;
+using span_trim_fn = basic_trim_fn_t<trim_span>;
+
+// Runs f over the resident span at pos when it accepts one, and over the trim string itself only if
+// the span turned out too short for it
+template<class F, class S, class... Args>
+trim_fn_rslt invoke_fast(F&& f, const S& s, index_t pos, const Args&... args) {
+    if constexpr (std::is_invocable_v<F, const trim_span&, index_t, const Args&...> && requires { s.window(pos); }) {
+        auto span = s.window(pos);
+        auto rslt = f(span, pos, args...);
+        if (!span.missed())
+            return rslt;
+    }
+    return f(s, pos, args...);
+}
 
 struct save_pos_t {};
 constexpr save_pos_t save_pos {};
@@ -232,7 +691,7 @@ constexpr save_pos_t save_pos {};
 struct extract_next_t {};
 constexpr extract_next_t extract_next {};
 
-inline trim_fn_rslt nop(const trim_str_like& s, index_t pos) { return pos; }
+inline constexpr auto nop = []<trim_str_c S>(const S& s, index_t pos) -> trim_fn_rslt { return pos; };
 
 template<class F, class... Args>
 concept trim_fn_c = requires {
@@ -243,15 +702,76 @@ concept trim_fn_c = requires {
 template<class F>
 concept trim_seq_el = trim_fn_c<F>;
 
+template<class F>
+concept seq_marker = std::same_as<F, save_pos_t> || std::same_as<F, extract_next_t>;
+
+inline constexpr auto skip_marker = [](auto, index_t) {};
+inline constexpr auto skip_trim = [](index_t, index_t) {};
+
+template<class S, class... Fs, size_t... I>
+trim_fn_rslt _invoke_seq(const S& s, index_t pos, const std::tuple<Fs...>& funcs, 
+                         std::array<index_t, sizeof...(Fs) + 1>& reached, std::index_sequence<I...>) {
+    trim_fn_rslt rslt = pos;
+    auto step = [&]<size_t K>(std::integral_constant<size_t, K>) {
+        reached[K] = *rslt;
+        if constexpr (seq_marker<std::tuple_element_t<K, std::tuple<Fs...>>>)
+            return true;
+        else if constexpr (std::same_as<S, trim_span>)
+            rslt = std::get<K>(funcs)(s, *rslt);
+        else
+            rslt = invoke_fast(std::get<K>(funcs), s, *rslt);
+        return rslt.has_value();
+    };
+    if ((step(std::integral_constant<size_t, I>{}) && ...))
+        reached.back() = *rslt;
+    return rslt;
+}
+
+// Applies elements of a sequence from pos until one fails. When all of them take spans, the whole sequence
+// runs over one resident span first. If it succeeds, markers are handed to on_marker with the position reached,
+// and trim functions to on_trim with the range they trimmed, in order
+template<class S, class... Fs, 
+         class OnMarker = std::decay_t<decltype(skip_marker)>, class OnTrim = std::decay_t<decltype(skip_trim)>>
+trim_fn_rslt invoke_seq(const S& s, index_t pos, const std::tuple<Fs...>& funcs, 
+                        OnMarker on_marker = skip_marker, OnTrim on_trim = skip_trim) {
+    using seq_t = std::index_sequence_for<Fs...>;
+    std::array<index_t, sizeof...(Fs) + 1> reached;
+    trim_fn_rslt rslt;
+    if constexpr (((seq_marker<Fs> || std::is_invocable_v<const Fs&, const trim_span&, index_t>) && ...) && 
+                  requires { s.window(pos); }) {
+        auto span = s.window(pos);
+        rslt = _invoke_seq(span, pos, funcs, reached, seq_t{});
+        if (span.missed())
+            rslt = _invoke_seq(s, pos, funcs, reached, seq_t{});
+    } else {
+        rslt = _invoke_seq(s, pos, funcs, reached, seq_t{});
+    }
+    if (rslt) {
+        [&]<size_t... I>(std::index_sequence<I...>) {
+            ([&] {
+                if constexpr (seq_marker<Fs>)
+                    on_marker(std::get<I>(funcs), reached[I]);
+                else
+                    on_trim(reached[I], reached[I + 1]);
+            }(), ...);
+        }(seq_t{});
+    }
+    return rslt;
+}
+
+// Sequences keep their elements, markers included, in the type, 
+// so that applying one unrolls into direct calls, that get inlined
 template<class... Fs>
     requires (sizeof...(Fs) > 1) && (trim_seq_el<Fs> && ...)
 struct trim_seq {
-    using element_t = trim_fn;
-
     static constexpr auto size = sizeof...(Fs);
-    const std::array<element_t, size> funcs;
+    const std::tuple<std::decay_t<Fs>...> funcs;
+
+    constexpr trim_seq(Fs&&... fs) : funcs(std::forward<Fs>(fs)...) {}
 
-    constexpr trim_seq(Fs&&... fs) : funcs({ std::forward<Fs>(fs)... }) {}
+    // So that a sequence is a trim function itself
+    template<trim_str_c S>
+    trim_fn_rslt operator()(const S& s, index_t pos) const { return invoke_seq(s, pos, funcs); }
 };
 
 template<class... Fs>
@@ -263,13 +783,11 @@ concept saving_trim_seq_el = trim_fn_c<F> || std::is_same_v<std::remove_cvref_t<
 template<class... Fs>
     requires (sizeof...(Fs) > 1) && (saving_trim_seq_el<Fs> && ...)
 struct saving_trim_seq {
-    using element_t = std::variant<trim_fn, save_pos_t>;
-
     static constexpr size_t size = sizeof...(Fs),
         saves = (std::is_same_v<std::remove_cvref_t<Fs>, save_pos_t> + ...);
-    const std::array<element_t, size> funcs;
+    const std::tuple<std::decay_t<Fs>...> funcs;
 
-    constexpr saving_trim_seq(Fs&&... fs) : funcs({ std::forward<Fs>(fs)... }) {}
+    constexpr saving_trim_seq(Fs&&... fs) : funcs(std::forward<Fs>(fs)...) {}
 };
 
 template<class... Fs>
@@ -281,13 +799,11 @@ concept ex_trim_seq_el = trim_seq_el<F> || std::is_same_v<std::remove_cvref_t<F>
 template<class... Fs>
     requires (sizeof...(Fs) > 1) && (ex_trim_seq_el<Fs> && ...)
 struct ex_trim_seq {
-    using element_t = std::variant<trim_fn, extract_next_t>;
-
     static constexpr size_t size = sizeof...(Fs),
         extracts = (std::is_same_v<std::remove_cvref_t<Fs>, extract_next_t> + ...);
-    const std::array<element_t, size> funcs;
+    const std::tuple<std::decay_t<Fs>...> funcs;
 
-    constexpr ex_trim_seq(Fs&&... fs) : funcs({ std::forward<Fs>(fs)... }) {}
+    constexpr ex_trim_seq(Fs&&... fs) : funcs(std::forward<Fs>(fs)...) {}
 };
 
 template<class... Fs>
@@ -297,24 +813,19 @@ ex_trim_seq(Fs&&... fs) -> ex_trim_seq<Fs...>;
 
 namespace trims {
 
-template<count_lines CountLines, use_saves Saves> 
-class trim_str_base : public _saving_trim_str_base<CountLines, Saves> {
+template<count_lines CountLines, use_saves Saves, buf_src Src = buf_src::stream> 
+class trim_str_base : public _saving_trim_str_base<CountLines, Saves, Src> {
 public:
     static constexpr auto saves = Saves;
-    using base = _saving_trim_str_base<CountLines, Saves>;
+    using base = _saving_trim_str_base<CountLines, Saves, Src>;
 private:
     template<class... Fs> requires(Saves == use_saves::yes)
     tf::trim_fn_rslt _apply_saving_seq_base(const tf::saving_trim_seq<Fs...>& seq) {
-        tf::trim_fn_rslt rslt = this->_pos;
-        std::vector<tf::index_t> saves;
-        saves.reserve(seq.saves);
-        for (auto it = seq.funcs.begin(); it != seq.funcs.end() && rslt.has_value(); ++it) {
-            if (it->index() == 0) {
-                rslt = std::get<0>(*it)(*this, *rslt);
-            } else {
-                saves.push_back(*rslt);
-            }
-        }
+        std::array<tf::index_t, tf::saving_trim_seq<Fs...>::saves> saves;
+        size_t n = 0;
+        auto rslt = tf::invoke_seq(*this, this->_pos, seq.funcs, [&](tf::save_pos_t, tf::index_t pos) { 
+            saves[n++] = pos; 
+        });
         if (rslt)
             std::copy(saves.begin(), saves.end(), std::back_inserter(*this->_saved));
         return rslt;
@@ -352,26 +863,17 @@ public:
 
     template<class F, class... Args> requires(tf::trim_fn_c<F, Args...>)
     tf::trim_fn_rslt invoke(F&& f, Args&&... args) const {
-        return f(*this, this->_pos, std::forward<Args>(args)...);
+        return tf::invoke_fast(f, *this, this->_pos, args...);
     }
 
     template<class... Fs>
     tf::trim_fn_rslt invoke(const tf::trim_seq<Fs...>& seq) const {
-        tf::trim_fn_rslt rslt = this->_pos;
-        for (auto it = seq.funcs.begin(); it != seq.funcs.end() && rslt.has_value(); ++it) {
-            rslt = (*it)(*this, *rslt);
-        }
-        return rslt;
+        return tf::invoke_seq(*this, this->_pos, seq.funcs);
     }
 
     template<class... Fs>
     tf::trim_fn_rslt invoke(const tf::saving_trim_seq<Fs...>& seq) const {
-        tf::trim_fn_rslt rslt = this->_pos;
-        for (auto it = seq.funcs.begin(); it != seq.funcs.end() && rslt.has_value(); ++it) {
-            if (it->index() == 0)
-                rslt = std::get<0>(*it)(*this, *rslt);
-        }
-        return rslt;
+        return tf::invoke_seq(*this, this->_pos, seq.funcs);
     }
 
     template<class F, class... Args> requires(tf::trim_fn_c<F, Args...>)
@@ -427,64 +929,104 @@ public:
 };
 
 using trim_str = trim_str_base<count_lines::yes, use_saves::yes>;
+using mapped_trim_str = trim_str_base<count_lines::yes, use_saves::yes, buf_src::mapped>;
+using view_trim_str = trim_str_base<count_lines::yes, use_saves::yes, buf_src::view>;
+using prefetch_trim_str = trim_str_base<count_lines::yes, use_saves::yes, buf_src::prefetch>;
+using fd_trim_str = trim_str_base<count_lines::yes, use_saves::yes, buf_src::fd>;
+using pipe_trim_str = trim_str_base<count_lines::yes, use_saves::yes, buf_src::pipe>;
+
+// Extracted pieces are either copied out into strings or recorded as spans of the source,
+// that are read through substr while their bytes are still buffered, with no allocation
+enum class extract_to { strings, spans };
+
+struct extracted_span {
+    index_t offset, length;
+};
 
-template<count_lines CountLines, use_saves Saves>
-class _ex_trim_str_base : public _saving_trim_str_base<CountLines, Saves> {
+template<count_lines CountLines, use_saves Saves, buf_src Src = buf_src::stream, 
+         extract_to Extract = extract_to::strings>
+class _ex_trim_str_base : public _saving_trim_str_base<CountLines, Saves, Src> {
 public:
-    using base = _saving_trim_str_base<CountLines, Saves>;
+    using base = _saving_trim_str_base<CountLines, Saves, Src>;
+    using typename base::source_t;
+    using extracted_t = std::conditional_t<Extract == extract_to::strings, std::string, extracted_span>;
 protected:
-    std::deque<std::string>* _extracted;
+    std::deque<extracted_t>* _extracted;
     bool _extract_next;
+
+    extracted_t _extracted_of(index_t from, index_t to) const {
+        if constexpr (Extract == extract_to::strings)
+            return std::string(this->substr(from, to - from));
+        else
+            return { from, to - from };
+    }
+    void _push_extracted(index_t to) { _extracted->push_back(_extracted_of(this->_pos, to)); }
+
+    // Spans left to pop hold the window back, so that they can still be read or pinned
+    index_t _held() const noexcept {
+        if constexpr (Extract == extract_to::spans) {
+            if (_extracted->size())
+                return std::min(base::_held(), _extracted->front().offset);
+        }
+        return base::_held();
+    }
+    void _upd_buf_start() { this->_buf.set_start(_held()); }
 public:
-    _ex_trim_str_base(std::istream& src, std::deque<std::string>& extracted) 
+    _ex_trim_str_base(source_t src, std::deque<extracted_t>& extracted) 
         requires(CountLines == count_lines::no && Saves == use_saves::no) 
         : base(src), _extracted(&extracted), _extract_next(false) {}
     
-    _ex_trim_str_base(std::istream& src, std::deque<index_t>& newlines, std::deque<std::string>& extracted) 
+    _ex_trim_str_base(source_t src, std::vector<index_t>& newlines, std::deque<extracted_t>& extracted) 
         requires(CountLines == count_lines::yes && Saves == use_saves::no) 
         : base(src, newlines), _extracted(&extracted), _extract_next(false) {}
     
-    _ex_trim_str_base(std::istream& src, std::deque<index_t>& saved, std::deque<std::string>& extracted) 
+    _ex_trim_str_base(source_t src, std::deque<index_t>& saved, std::deque<extracted_t>& extracted) 
         requires(CountLines == count_lines::no && Saves == use_saves::yes) 
         : base(src, saved), _extracted(&extracted), _extract_next(false) {}
     
-    _ex_trim_str_base(std::istream& src, std::deque<index_t>& newlines, 
-                      std::deque<tf::index_t>& saved, std::deque<std::string>& extracted) 
+    _ex_trim_str_base(source_t src, std::vector<index_t>& newlines, 
+                      std::deque<tf::index_t>& saved, std::deque<extracted_t>& extracted) 
         requires(CountLines == count_lines::yes && Saves == use_saves::yes) 
         : base(src, newlines, saved), _extracted(&extracted), _extract_next(false) {}
     
-    std::deque<std::string>* const& extracted() const noexcept { 
+    std::deque<extracted_t>* const& extracted() const noexcept { 
         return _extracted; 
     }
-    std::deque<std::string>* extracted(std::deque<std::string>& extracted) { 
-        return std::exchange(_extracted, &_extracted); 
+    std::deque<extracted_t>* extracted(std::deque<extracted_t>& extracted) { 
+        return std::exchange(_extracted, &extracted); 
     }
 
     void extract_next() noexcept { _extract_next = true; }
-    std::string pop_extracted() {
+    extracted_t pop_extracted() {
         auto ret = std::move(_extracted->back());
         return _extracted->pop_back(), ret;
     }
+    // Last extracted piece as a view, that is valid as long as the source or arena
+    std::string_view pop_pinned(text_arena& arena) {
+        auto popped = pop_extracted();
+        if constexpr (Extract == extract_to::strings)
+            return arena.keep(popped);
+        else
+            return this->pin(popped.offset, popped.length, arena);
+    }
 };
 
-template<count_lines CountLines, use_saves Saves>
-class ex_trim_str_base : public _ex_trim_str_base<CountLines, Saves> {
+template<count_lines CountLines, use_saves Saves, buf_src Src = buf_src::stream, 
+         extract_to Extract = extract_to::strings>
+class ex_trim_str_base : public _ex_trim_str_base<CountLines, Saves, Src, Extract> {
 public:
     static constexpr auto saves = Saves;
-    using base = _ex_trim_str_base<CountLines, Saves>;
+    static constexpr auto extract = Extract;
+    using base = _ex_trim_str_base<CountLines, Saves, Src, Extract>;
+    using typename base::extracted_t;
 private:
     template<class... Fs> requires(Saves == use_saves::yes)
     tf::trim_fn_rslt _apply_saving_seq_base(const tf::saving_trim_seq<Fs...>& seq) {
-        tf::trim_fn_rslt rslt = this->_pos;
-        std::vector<tf::index_t> saves;
-        saves.reserve(seq.saves);
-        for (auto it = seq.funcs.begin(); it != seq.funcs.end() && rslt.has_value(); ++it) {
-            if (it->index() == 0) {
-                rslt = std::get<0>(*it)(*this, *rslt);
-            } else {
-                saves.push_back(*rslt);
-            }
-        }
+        std::array<tf::index_t, tf::saving_trim_seq<Fs...>::saves> saves;
+        size_t n = 0;
+        auto rslt = tf::invoke_seq(*this, this->_pos, seq.funcs, [&](tf::save_pos_t, tf::index_t pos) { 
+            saves[n++] = pos; 
+        });
         if (rslt)
             std::copy(saves.begin(), saves.end(), std::back_inserter(*this->_saved));
         return rslt;
@@ -492,22 +1034,17 @@ private:
 
     template<class... Fs>
     tf::trim_fn_rslt _apply_ex_seq_base(const tf::ex_trim_seq<Fs...>& seq) {
-        tf::trim_fn_rslt rslt = this->_pos;
-        std::vector<std::string> extracted;
-        extracted.reserve(seq.extracts);
+        std::array<extracted_t, tf::ex_trim_seq<Fs...>::extracts> extracted;
+        size_t n = 0;
         bool extract_next = false;
-        for (auto it = seq.funcs.begin(); it != seq.funcs.end() && rslt.has_value(); ++it) {
-            if (it->index() == 1) {
-                extract_next = true;
-            } else {
-                auto n_rslt = std::get<0>(*it)(*this, *rslt);
-                if (extract_next && n_rslt)
-                    extracted.emplace_back(this->substr(*rslt, *n_rslt - *rslt));
-                rslt = n_rslt, extract_next = false;
-            }
-        }
+        auto rslt = tf::invoke_seq(*this, this->_pos, seq.funcs, 
+            [&](tf::extract_next_t, tf::index_t) { extract_next = true; },
+            [&](tf::index_t from, tf::index_t to) {
+                if (std::exchange(extract_next, false))
+                    extracted[n++] = this->_extracted_of(from, to);
+            });
         if (rslt)
-            std::move(extracted.begin(), extracted.end(), std::back_inserter(*this->_extracted));
+            std::move(extracted.begin(), extracted.begin() + n, std::back_inserter(*this->_extracted));
         return rslt;
     }
 public:
@@ -545,36 +1082,22 @@ public:
 
     template<class F, class... Args> requires(tf::trim_fn_c<F, Args...>)
     tf::trim_fn_rslt invoke(F&& f, Args&&... args) const {
-        return f(*this, this->_pos, std::forward<Args>(args)...);
+        return tf::invoke_fast(f, *this, this->_pos, args...);
     }
 
     template<class... Fs>
     tf::trim_fn_rslt invoke(const tf::trim_seq<Fs...>& seq) const {
-        tf::trim_fn_rslt rslt = this->_pos;
-        for (auto it = seq.funcs.begin(); it != seq.funcs.end() && rslt.has_value(); ++it) {
-            rslt = (*it)(*this, *rslt);
-        }
-        return rslt;
+        return tf::invoke_seq(*this, this->_pos, seq.funcs);
     }
 
     template<class... Fs>
     tf::trim_fn_rslt invoke(const tf::saving_trim_seq<Fs...>& seq) const {
-        tf::trim_fn_rslt rslt = this->_pos;
-        for (auto it = seq.funcs.begin(); it != seq.funcs.end() && rslt.has_value(); ++it) {
-            if (it->index() == 0)
-                rslt = std::get<0>(*it)(*this, *rslt);
-        }
-        return rslt;
+        return tf::invoke_seq(*this, this->_pos, seq.funcs);
     }
 
     template<class... Fs>
     tf::trim_fn_rslt invoke(const tf::ex_trim_seq<Fs...>& seq) const {
-        tf::trim_fn_rslt rslt = this->_pos;
-        for (auto it = seq.funcs.begin(); it != seq.funcs.end() && rslt.has_value(); ++it) {
-            if (it->index() == 0)
-                rslt = std::get<0>(*it)(*this, *rslt);
-        }
-        return rslt;
+        return tf::invoke_seq(*this, this->_pos, seq.funcs);
     }
 
     template<class F, class... Args> requires(tf::trim_fn_c<F, Args...>)
@@ -582,7 +1105,7 @@ public:
         auto rslt = invoke(std::forward<F>(f), std::forward<Args>(args)...);
         if (rslt) {
             if (this->_extract_next)
-                this->_extracted->emplace_back(this->substr(this->_pos, *rslt - this->_pos));
+                this->_push_extracted(*rslt);
             this->_pos = *rslt, this->_upd_buf_start();
         }
         this->_extract_next = false;
@@ -594,7 +1117,7 @@ public:
         auto rslt = invoke(seq);
         if (rslt) {
             if (this->_extract_next)
-                this->_extracted->emplace_back(this->substr(this->_pos, *rslt - this->_pos));
+                this->_push_extracted(*rslt);
             this->_pos = *rslt, this->_upd_buf_start();
         }
         this->_extract_next = false;
@@ -606,7 +1129,7 @@ public:
         auto rslt = _apply_saving_seq_base(seq);
         if (rslt) {
             if (this->_extract_next)
-                this->_extracted->emplace_back(this->substr(this->_pos, *rslt - this->_pos));
+                this->_push_extracted(*rslt);
             this->_pos = *rslt, this->_upd_buf_start();
         }
         this->_extract_next = false;
@@ -618,7 +1141,7 @@ public:
         auto rslt = _apply_ex_seq_base(seq);
         if (rslt) {
             if (this->_extract_next)
-                this->_extracted->emplace_back(this->substr(this->_pos, *rslt - this->_pos));
+                this->_push_extracted(*rslt);
             this->_pos = *rslt, this->_upd_buf_start();
         }
         this->_extract_next = false;
@@ -629,7 +1152,7 @@ public:
     auto& apply(F&& f, Args&&... args) {
         auto rslt = invoke(std::forward<F>(f), std::forward<Args>(args)...);
         if (rslt && this->_extract_next)
-            this->_extracted->emplace_back(this->substr(this->_pos, *rslt - this->_pos));
+            this->_push_extracted(*rslt);
         if (this->_pos = rslt.value_or(-1); rslt) 
             this->_upd_buf_start();
         this->_extract_next = false;
@@ -640,7 +1163,7 @@ public:
     auto& apply(const tf::trim_seq<Fs...>& seq) {
         auto rslt = invoke(seq);
         if (rslt && this->_extract_next)
-            this->_extracted->emplace_back(this->substr(this->_pos, *rslt - this->_pos));
+            this->_push_extracted(*rslt);
         if (this->_pos = rslt.value_or(-1); rslt) 
             this->_upd_buf_start();
         this->_extract_next = false;
@@ -651,7 +1174,7 @@ public:
     auto& apply(const tf::saving_trim_seq<Fs...>& seq) {
         auto rslt = _apply_saving_seq_base(seq);
         if (rslt && this->_extract_next)
-            this->_extracted->emplace_back(this->substr(this->_pos, *rslt - this->_pos));
+            this->_push_extracted(*rslt);
         if (this->_pos = rslt.value_or(-1); rslt) 
             this->_upd_buf_start();
         this->_extract_next = false;
@@ -662,7 +1185,7 @@ public:
     auto& apply(const tf::ex_trim_seq<Fs...>& seq) {
         auto rslt = _apply_ex_seq_base(seq);
         if (rslt && this->_extract_next)
-            this->_extracted->emplace_back(this->substr(this->_pos, *rslt - this->_pos));
+            this->_push_extracted(*rslt);
         if (this->_pos = rslt.value_or(-1); rslt) 
             this->_upd_buf_start();
         this->_extract_next = false;
@@ -671,5 +1194,19 @@ public:
 };
 
 using ex_trim_str = ex_trim_str_base<count_lines::yes, use_saves::yes>;
+using mapped_ex_trim_str = ex_trim_str_base<count_lines::yes, use_saves::yes, buf_src::mapped>;
+using view_ex_trim_str = ex_trim_str_base<count_lines::yes, use_saves::yes, buf_src::view>;
+using prefetch_ex_trim_str = ex_trim_str_base<count_lines::yes, use_saves::yes, buf_src::prefetch>;
+using fd_ex_trim_str = ex_trim_str_base<count_lines::yes, use_saves::yes, buf_src::fd>;
+using pipe_ex_trim_str = ex_trim_str_base<count_lines::yes, use_saves::yes, buf_src::pipe>;
+
+using span_ex_trim_str = ex_trim_str_base<count_lines::yes, use_saves::yes, buf_src::stream, extract_to::spans>;
+using mapped_span_ex_trim_str = 
+    ex_trim_str_base<count_lines::yes, use_saves::yes, buf_src::mapped, extract_to::spans>;
+using view_span_ex_trim_str = ex_trim_str_base<count_lines::yes, use_saves::yes, buf_src::view, extract_to::spans>;
+using prefetch_span_ex_trim_str = 
+    ex_trim_str_base<count_lines::yes, use_saves::yes, buf_src::prefetch, extract_to::spans>;
+using fd_span_ex_trim_str = ex_trim_str_base<count_lines::yes, use_saves::yes, buf_src::fd, extract_to::spans>;
+using pipe_span_ex_trim_str = ex_trim_str_base<count_lines::yes, use_saves::yes, buf_src::pipe, extract_to::spans>;
 
 }
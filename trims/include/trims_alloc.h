@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace trims {
+
+// Allocations, that arenas, buffers and containers of the library ask for. They are counted into the stats
+// of the innermost count_allocs, that is alive on the thread, so that all of a call is counted without a hook in it
+struct alloc_stats {
+    size_t allocations = 0, bytes = 0;
+};
+
+inline thread_local alloc_stats* _counted_allocs = nullptr;
+
+inline void count_alloc(size_t bytes) noexcept {
+    if (_counted_allocs)
+        ++_counted_allocs->allocations, _counted_allocs->bytes += bytes;
+}
+
+class count_allocs {
+private:
+    alloc_stats* _outer;
+public:
+    count_allocs(alloc_stats& stats) noexcept : _outer(std::exchange(_counted_allocs, &stats)) {}
+    count_allocs(const count_allocs&) = delete;
+    ~count_allocs() { _counted_allocs = _outer; }
+};
+
+// std::allocator, that counts what it allocates
+template<class T>
+struct counting_allocator : std::allocator<T> {
+    using value_type = T;
+
+    counting_allocator() noexcept = default;
+    template<class U>
+    counting_allocator(const counting_allocator<U>&) noexcept {}
+
+    T* allocate(size_t n) {
+        count_alloc(n * sizeof(T));
+        return std::allocator<T>::allocate(n);
+    }
+};
+
+template<class T>
+using counted_vector = std::vector<T, counting_allocator<T>>;
+using counted_string = std::basic_string<char, std::char_traits<char>, counting_allocator<char>>;
+
+// make_unique, that counts
+template<class T, class... Args> requires (!std::is_array_v<T>)
+std::unique_ptr<T> make_counted(Args&&... args) {
+    count_alloc(sizeof(T));
+    return std::make_unique<T>(std::forward<Args>(args)...);
+}
+
+template<class T> requires std::is_unbounded_array_v<T>
+std::unique_ptr<T> make_counted(size_t n) {
+    count_alloc(n * sizeof(std::remove_extent_t<T>));
+    return std::make_unique<T>(n);
+}
+
+template<class T> requires std::is_unbounded_array_v<T>
+std::unique_ptr<T> make_counted_for_overwrite(size_t n) {
+    count_alloc(n * sizeof(std::remove_extent_t<T>));
+    return std::make_unique_for_overwrite<T>(n);
+}
+
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "trims.h"
+
+namespace tf {
+
+// Combinators compose trim functions into trim functions. They run over whatever they are given,
+// so on resident spans too, when all of their parts do
+
+template<class F>
+struct first_t;
+
+template<class... Fs>
+struct one_of_t;
+
+// Bytes a trim function can start with, all of them unless it tells
+template<class F>
+constexpr scan::char_class first_bytes(const F&) noexcept {
+    return ~scan::char_class();
+}
+
+template<class F>
+constexpr scan::char_class first_bytes(const first_t<F>& f) noexcept {
+    return f.cls;
+}
+
+template<class... Fs>
+constexpr scan::char_class first_bytes(const one_of_t<Fs...>& f) noexcept {
+    return f.cls;
+}
+
+// Trim function, that fails unless the byte at pos is in cls, so that one_of can dispatch on it
+template<class F>
+struct first_t {
+    scan::char_class cls;
+    F f;
+
+    template<trim_str_c S> requires std::is_invocable_v<const F&, const S&, index_t>
+    trim_fn_rslt operator()(const S& s, index_t pos) const {
+        if (pos >= s.size() || !cls.test(s[pos]))
+            return std::unexpected(pos);
+        return f(s, pos);
+    }
+};
+
+template<class F>
+constexpr first_t<std::decay_t<F>> first(const scan::char_class& cls, F&& f) {
+    return { cls, std::forward<F>(f) };
+}
+
+// Tries the one alternative, that the byte at pos selects, through a table of 256 entries.
+// Where first bytes of alternatives overlap the earlier one wins, alternatives without first bytes take all
+template<class... Fs>
+struct one_of_t {
+    static constexpr uint8_t none = sizeof...(Fs);
+    static_assert(sizeof...(Fs) < 256);
+
+    std::tuple<Fs...> alts;
+    std::array<uint8_t, 256> dispatch;
+    scan::char_class cls;
+
+    constexpr one_of_t(Fs... fs) : alts(std::move(fs)...), dispatch{}, cls{} {
+        dispatch.fill(none);
+        [&]<size_t... I>(std::index_sequence<I...>) {
+            (_add(first_bytes(std::get<I>(alts)), I), ...);
+        }(std::index_sequence_for<Fs...>{});
+    }
+
+    template<trim_str_c S> requires (std::is_invocable_v<const Fs&, const S&, index_t> && ...)
+    trim_fn_rslt operator()(const S& s, index_t pos) const {
+        if (pos >= s.size())
+            return std::unexpected(pos);
+        uint8_t alt = dispatch[static_cast<unsigned char>(s[pos])];
+        trim_fn_rslt rslt = std::unexpected(pos);
+        [&]<size_t... I>(std::index_sequence<I...>) {
+            ((alt == I ? (rslt = std::get<I>(alts)(s, pos), true) : false) || ...);
+        }(std::index_sequence_for<Fs...>{});
+        return rslt;
+    }
+private:
+    constexpr void _add(const scan::char_class& first, uint8_t i) {
+        for (int c = 0; c < 256; ++c) {
+            if (first.test(c) && dispatch[c] == none)
+                dispatch[c] = i, cls.set(c);
+        }
+    }
+};
+
+template<class... Fs>
+constexpr one_of_t<std::decay_t<Fs>...> one_of(Fs&&... fs) {
+    return { std::forward<Fs>(fs)... };
+}
+
+// Applies f while it succeeds and moves on, never fails
+template<class F>
+struct many_t {
+    F f;
+
+    template<trim_str_c S> requires std::is_invocable_v<const F&, const S&, index_t>
+    trim_fn_rslt operator()(const S& s, index_t pos) const {
+        for (trim_fn_rslt rslt = f(s, pos); rslt && *rslt != pos; rslt = f(s, pos))
+            pos = *rslt;
+        return pos;
+    }
+};
+
+template<class F>
+constexpr many_t<std::decay_t<F>> many(F&& f) {
+    return { std::forward<F>(f) };
+}
+
+// Applies f, stays at pos where it fails
+template<class F>
+struct optional_t {
+    F f;
+
+    template<trim_str_c S> requires std::is_invocable_v<const F&, const S&, index_t>
+    trim_fn_rslt operator()(const S& s, index_t pos) const {
+        return f(s, pos).value_or(pos);
+    }
+};
+
+template<class F>
+constexpr optional_t<std::decay_t<F>> optional(F&& f) {
+    return { std::forward<F>(f) };
+}
+
+// Zero or more of f separated by sep, a separator without f after it isnt trimmed
+template<class F, class Sep>
+struct sep_by_t {
+    F f;
+    Sep sep;
+
+    template<trim_str_c S>
+        requires std::is_invocable_v<const F&, const S&, index_t> && std::is_invocable_v<const Sep&, const S&, index_t>
+    trim_fn_rslt operator()(const S& s, index_t pos) const {
+        trim_fn_rslt rslt = f(s, pos);
+        while (rslt && *rslt != pos) {
+            pos = *rslt;
+            trim_fn_rslt next = sep(s, pos);
+            if (!next)
+                break;
+            rslt = f(s, *next);
+        }
+        return pos;
+    }
+};
+
+template<class F, class Sep>
+constexpr sep_by_t<std::decay_t<F>, std::decay_t<Sep>> sep_by(F&& f, Sep&& sep) {
+    return { std::forward<F>(f), std::forward<Sep>(sep) };
+}
+
+}
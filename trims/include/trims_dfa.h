@@ -0,0 +1,144 @@
+#pragma once
+
+#include "trims.h"
+
+namespace tf {
+
+// Regular token rules declared as transitions between numbered states on byte classes, from state 0.
+// They are lowered at compile time into a dense table over classes of bytes, that no transition tells apart,
+// and run as a loop of one load per byte, trimming the longest accepted prefix. The rules are a template
+// argument, so that the table has a column per class rather than per byte
+
+struct dfa_edge {
+    uint8_t from;
+    scan::char_class on;
+    uint8_t to;
+};
+
+// Class of every byte, bytes in the same edges behave the same in every state
+template<size_t Edges>
+constexpr std::array<uint8_t, 256> dfa_byte_classes(const std::array<dfa_edge, Edges>& edges) {
+    static_assert(Edges <= 64);
+    std::array<uint64_t, 256> signature {};
+    for (int c = 0; c < 256; ++c) {
+        for (size_t e = 0; e < Edges; ++e)
+            signature[c] |= uint64_t(edges[e].on.test(c)) << e;
+    }
+    std::array<uint8_t, 256> byte_class {};
+    uint8_t classes = 0;
+    for (int c = 0; c < 256; ++c) {
+        int same = 0;
+        while (same < c && signature[same] != signature[c]) ++same;
+        byte_class[c] = same < c ? byte_class[same] : classes++;
+    }
+    return byte_class;
+}
+
+template<size_t Edges>
+constexpr size_t dfa_classes(const std::array<dfa_edge, Edges>& edges) {
+    auto byte_class = dfa_byte_classes(edges);
+    return *std::max_element(byte_class.begin(), byte_class.end()) + 1;
+}
+
+template<size_t States, size_t Classes, size_t Edges>
+struct dfa_t {
+    static_assert(States < 255 && Edges <= 64);
+    static constexpr uint16_t dead = -1;
+    static constexpr size_t classes = Classes;
+
+    // Transitions are kept as offsets of the rows of their targets, so that no multiply is on the way
+    std::array<uint8_t, 256> byte_class {};
+    std::array<uint16_t, States * Classes> next {};
+    std::array<bool, States * Classes> accepted {};
+    bool accepts_empty = false;
+
+    constexpr dfa_t(const std::array<dfa_edge, Edges>& edges, std::initializer_list<uint8_t> accepts) 
+        : byte_class(dfa_byte_classes(edges)) {
+        std::array<bool, States> accepting {};
+        for (uint8_t state : accepts)
+            accepting[state] = true;
+        accepts_empty = accepting[0];
+        std::fill(next.begin(), next.end(), dead);
+        for (int c = 0; c < 256; ++c) {
+            for (const dfa_edge& edge : edges) {
+                size_t at = edge.from * classes + byte_class[c];
+                if (edge.on.test(c) && next[at] == dead)
+                    next[at] = edge.to * classes, accepted[at] = accepting[edge.to];
+            }
+        }
+    }
+
+    template<trim_str_c S>
+    trim_fn_rslt operator()(const S& s, index_t pos) const {
+        size_t row = 0;
+        index_t end = accepts_empty ? pos : index_t(-1);
+        auto step = [&](unsigned char c, index_t i) {
+            size_t at = row + byte_class[c];
+            if (next[at] == dead)
+                return false;
+            end = accepted[at] ? i + 1 : end, row = next[at];
+            return true;
+        };
+        if constexpr (std::same_as<S, trim_span>) {
+            index_t size = s.size();
+            if (pos >= size)
+                return accepts_empty ? trim_fn_rslt(pos) : trim_fn_rslt(std::unexpected(pos));
+            if (pos < s.begin() || pos >= s.end())
+                return s.miss(), std::unexpected(pos);
+            const char* data = s.data(pos);
+            index_t i = pos;
+            while (i < s.end() && step(data[i - pos], i)) ++i;
+            if (i == s.end() && i < size)
+                s.miss();
+        } else {
+            for (index_t i = pos; i < s.size() && step(s[i], i); ++i);
+        }
+        if (end == index_t(-1))
+            return std::unexpected(pos);
+        return end;
+    }
+};
+
+template<size_t States, std::array Edges>
+constexpr dfa_t<States, dfa_classes(Edges), Edges.size()> dfa(std::initializer_list<uint8_t> accepts) {
+    return { Edges, accepts };
+}
+
+namespace program_trims {
+
+namespace _number {
+    enum : uint8_t { start, digits, zero, hex_prefix, hex_digits, dot, fraction, exp, exp_sign, exp_digits, suffix,
+                     states };
+
+    constexpr scan::char_class digit = scan::classes::digit, nonzero = scan::char_class::range('1', '9'),
+        hex = digit | scan::char_class::range('a', 'f') | scan::char_class::range('A', 'F'),
+        int_suffix = scan::char_class::of("uUlL"), float_suffix = scan::char_class::of("fFlL");
+}
+
+// Decimal, hex and floating point literals with C suffixes, as 12, 0x1fu, 1.5e-3f
+inline constexpr auto trim_number = [] {
+    using namespace _number;
+    return dfa<states, std::to_array<dfa_edge>({
+        { start, scan::char_class::of("0"), zero }, { start, nonzero, digits },
+        { zero, scan::char_class::of("xX"), hex_prefix }, { zero, digit, digits }, { digits, digit, digits },
+        { hex_prefix, hex, hex_digits }, { hex_digits, hex, hex_digits },
+        { zero, scan::char_class::of("."), dot }, { digits, scan::char_class::of("."), dot },
+        { dot, digit, fraction }, { fraction, digit, fraction },
+        { zero, scan::char_class::of("eE"), exp }, { digits, scan::char_class::of("eE"), exp },
+        { dot, scan::char_class::of("eE"), exp }, { fraction, scan::char_class::of("eE"), exp },
+        { exp, scan::char_class::of("+-"), exp_sign }, { exp, digit, exp_digits }, { exp_sign, digit, exp_digits },
+        { exp_digits, digit, exp_digits },
+        { zero, int_suffix, suffix }, { digits, int_suffix, suffix }, { hex_digits, int_suffix, suffix },
+        { dot, float_suffix, suffix }, { fraction, float_suffix, suffix }, { exp_digits, float_suffix, suffix },
+        { suffix, int_suffix, suffix },
+    })>({ digits, zero, hex_digits, dot, fraction, exp_digits, suffix });
+}();
+
+// Identifiers, a letter or '_' and then letters, digits or '_'
+inline constexpr auto trim_identifier = dfa<2, std::to_array<dfa_edge>({
+    { 0, scan::classes::alpha | scan::char_class::of("_"), 1 }, { 1, scan::classes::ident, 1 },
+})>({ 1 });
+
+}
+
+}
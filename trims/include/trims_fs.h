@@ -5,99 +5,206 @@
 
 namespace tf {
 
-inline trim_fn_rslt trim_char(const trim_str_like& s, index_t pos, char c) {
+// Trim functions are generic lambdas over trim_str_c, so that they run on resident spans without virtual calls,
+// and still convert to trim_fn where a function pointer is needed. Predicates may be lambdas to get inlined
+
+inline constexpr auto trim_char = []<trim_str_c S>(const S& s, index_t pos, char c) -> trim_fn_rslt {
     if (pos < s.size() && s[pos] == c)
         return pos + 1;
     return std::unexpected(pos);
-}
+};
 
 #define trim_char_t(c) \
-    [](const tf::trim_str_like& str, tf::index_t pos) { return tf::trim_char(str, pos, c); }
+    [](const auto& str, tf::index_t pos) { return tf::trim_char(str, pos, c); }
 
-inline trim_fn_rslt trim_char_if(const trim_str_like& s, index_t pos, int (*f)(int)) {
+inline constexpr auto trim_char_if = 
+    []<trim_str_c S, class P = int (*)(int)>(const S& s, index_t pos, P f) -> trim_fn_rslt {
     if (pos < s.size() && f(s[pos]))
         return pos + 1;
     return std::unexpected(pos);
-}
+};
 
 #define trim_char_if_t(f) \
-    [](const tf::trim_str_like& str, tf::index_t pos) { return tf::trim_char_if(str, pos, f); }
+    [](const auto& str, tf::index_t pos) { return tf::trim_char_if(str, pos, f); }
 
-inline trim_fn_rslt trim_chars(const trim_str_like& s, index_t pos, std::string_view chars) {
-    index_t i = 0;
-    for (; i < chars.size() && pos < s.size(); ++pos, ++i) {
-        if (chars[i] != s[pos])
+inline constexpr auto trim_chars = []<trim_str_c S>(const S& s, index_t pos, std::string_view chars) -> trim_fn_rslt {
+    if constexpr (std::same_as<S, trim_span>) {
+        index_t size = s.size();
+        index_t n = std::min<index_t>(chars.size(), size - std::min(pos, size));
+        if (pos < s.begin() || pos + n > s.end())
+            return s.miss(), std::unexpected(pos);
+        index_t i = n && *s.data(pos) != chars[0] ? 0 : scan::mismatch(s.data(pos), chars.data(), n);
+        if (i != chars.size())
+            return std::unexpected(pos + i);
+        return pos + i;
+    } else {
+        index_t i = 0;
+        for (; i < chars.size() && pos < s.size(); ++pos, ++i) {
+            if (chars[i] != s[pos])
+                return std::unexpected(pos);
+        }
+        if (i != chars.size())
             return std::unexpected(pos);
+        return pos;
     }
-    if (i != chars.size())
-        return std::unexpected(pos);
-    return pos;
-}
+};
 
 #define trim_chars_t(chars) \
-    [](const tf::trim_str_like& str, tf::index_t pos) { return tf::trim_chars(str, pos, chars); }
+    [](const auto& str, tf::index_t pos) { return tf::trim_chars(str, pos, chars); }
 
-inline trim_fn_rslt trim_word(const trim_str_like& s, index_t pos, std::string_view word) {
+inline constexpr auto trim_word = []<trim_str_c S>(const S& s, index_t pos, std::string_view word) -> trim_fn_rslt {
     auto rslt = trim_chars(s, pos, word);
-    if (!rslt || (*rslt == s.size()) || (*rslt < s.size() && std::isspace(s[*rslt])))
+    if (!rslt || (*rslt == s.size()) || (*rslt < s.size() && scan::is(s[*rslt], scan::kinds::space)))
         return rslt;
     return std::unexpected(pos);
-}
+};
 
 #define trim_word_t(word) \
-    [](const tf::trim_str_like& str, tf::index_t pos) { return tf::trim_word(str, pos, word); }
+    [](const auto& str, tf::index_t pos) { return tf::trim_word(str, pos, word); }
+
+// Words to be probed at once: they are bucketed by first byte, longest first, 
+// and the ones up to 8 bytes long are compared by a single masked load on resident spans
+template<size_t N>
+struct word_set {
+    std::array<std::string_view, N> words;
+    std::array<uint16_t, 257> buckets {};
+    std::array<uint64_t, N> prefixes {}, masks {};
+
+    template<class... W>
+    constexpr word_set(W... ws) : words{ std::string_view(ws)... } {
+        std::sort(words.begin(), words.end(), [](std::string_view a, std::string_view b) {
+            return a[0] != b[0] ? static_cast<unsigned char>(a[0]) < static_cast<unsigned char>(b[0]) 
+                                : a.size() > b.size();
+        });
+        for (std::string_view word : words)
+            ++buckets[static_cast<unsigned char>(word[0]) + 1];
+        for (size_t c = 1; c < buckets.size(); ++c)
+            buckets[c] += buckets[c - 1];
+        for (size_t i = 0; i < N; ++i) {
+            std::array<char, 8> prefix {}, mask {};
+            for (size_t j = 0; j < std::min<size_t>(words[i].size(), 8); ++j)
+                prefix[j] = words[i][j], mask[j] = '\xff';
+            prefixes[i] = std::bit_cast<uint64_t>(prefix), masks[i] = std::bit_cast<uint64_t>(mask);
+        }
+    }
+};
 
-inline trim_fn_rslt trim_while_true(const trim_str_like& s, index_t pos, int (*f)(int)) {
+template<class... W>
+word_set(W...) -> word_set<sizeof...(W)>;
+
+// Longest of the words at pos, that is followed by a space or the end
+inline constexpr auto trim_words = 
+    []<trim_str_c S, size_t N>(const S& s, index_t pos, const word_set<N>& set) -> trim_fn_rslt {
+    if (pos >= s.size())
+        return std::unexpected(pos);
+    unsigned char c = s[pos];
+    uint64_t loaded = 0;
+    bool probe = false;
+    if constexpr (std::same_as<S, trim_span>) {
+        if ((probe = pos >= s.begin() && pos + 8 <= s.end()))
+            std::memcpy(&loaded, s.data(pos), 8);
+    }
+    for (size_t i = set.buckets[c]; i < set.buckets[c + 1]; ++i) {
+        index_t size = set.words[i].size();
+        if (probe && size <= 8) {
+            if ((loaded & set.masks[i]) == set.prefixes[i] && 
+                    (pos + size == s.size() || scan::is(s[pos + size], scan::kinds::space)))
+                return pos + size;
+        } else if (auto rslt = trim_word(s, pos, set.words[i])) {
+            return rslt;
+        }
+    }
+    return std::unexpected(pos);
+};
+
+#define trim_words_t(set) \
+    [](const auto& str, tf::index_t pos) { return tf::trim_words(str, pos, set); }
+
+inline constexpr auto trim_while_true = 
+    []<trim_str_c S, class P = int (*)(int)>(const S& s, index_t pos, P f) -> trim_fn_rslt {
     while (pos < s.size() && f(s[pos])) ++pos;
     return pos;
-}
+};
 
 #define trim_while_true_t(f) \
-    [](const tf::trim_str_like& str, tf::index_t pos) { return tf::trim_while_true(str, pos, f); }
+    [](const auto& str, tf::index_t pos) { return tf::trim_while_true(str, pos, f); }
 
-inline trim_fn_rslt trim_while_false(const trim_str_like& s, index_t pos, int (*f)(int)) {
+inline constexpr auto trim_while_false = 
+    []<trim_str_c S, class P = int (*)(int)>(const S& s, index_t pos, P f) -> trim_fn_rslt {
     while (pos < s.size() && !f(s[pos])) ++pos;
     return pos;
-}
+};
 
 #define trim_while_false_t(f) \
-    [](const tf::trim_str_like& str, tf::index_t pos) { return tf::trim_while_false(str, pos, f); }
+    [](const auto& str, tf::index_t pos) { return tf::trim_while_false(str, pos, f); }
+
+// Same as trim_while_true/false, but over a byte class, which vector kernels scan on resident spans
+template<bool In>
+inline constexpr auto _trim_while_class = 
+    []<trim_str_c S>(const S& s, index_t pos, const scan::char_class& cls) -> trim_fn_rslt {
+    if constexpr (std::same_as<S, trim_span>) {
+        index_t size = s.size();
+        if (pos >= size)
+            return pos;
+        if (pos < s.begin() || pos >= s.end())
+            return s.miss(), pos;
+        index_t n = s.end() - pos;
+        index_t skip = In ? scan::find_first_not_of(s.data(pos), n, cls) : scan::find_first_of(s.data(pos), n, cls);
+        if (skip == n && s.end() < size)
+            s.miss();
+        return pos + skip;
+    } else {
+        while (pos < s.size() && cls.test(s[pos]) == In) ++pos;
+        return pos;
+    }
+};
+
+inline constexpr auto trim_while_in = _trim_while_class<true>;
+
+#define trim_while_in_t(cls) \
+    [](const auto& str, tf::index_t pos) { return tf::trim_while_in(str, pos, cls); }
 
-inline trim_fn_rslt trim_while_start(const trim_str_like& s, index_t pos) {
+inline constexpr auto trim_while_not_in = _trim_while_class<false>;
+
+#define trim_while_not_in_t(cls) \
+    [](const auto& str, tf::index_t pos) { return tf::trim_while_not_in(str, pos, cls); }
+
+inline constexpr auto trim_while_start = []<trim_str_c S>(const S& s, index_t pos) -> trim_fn_rslt {
     for (index_t i = pos + 1; i < s.size(); ++i) {
         if (s[pos] != s[i])
             return i;
     }
     return s.size();
-}
+};
 
-inline trim_fn_rslt trim_spaces(const trim_str_like& s, index_t pos) {
-    return trim_while_true(s, pos, std::isspace);
-}
+inline constexpr auto trim_spaces = []<trim_str_c S>(const S& s, index_t pos) -> trim_fn_rslt {
+    return trim_while_in(s, pos, scan::classes::space);
+};
 
-inline trim_fn_rslt trim_spaces_require(const trim_str_like& s, index_t pos) {
+inline constexpr auto trim_spaces_require = []<trim_str_c S>(const S& s, index_t pos) -> trim_fn_rslt {
     index_t _pos = *trim_spaces(s, pos);
     if (pos == _pos)
         return std::unexpected(pos);
     return _pos;
-}
+};
 
-inline trim_fn_rslt trim_until_spacing(const trim_str_like& s, index_t pos) {
-    return trim_while_false(s, pos, std::isspace);
-}
+inline constexpr auto trim_until_spacing = []<trim_str_c S>(const S& s, index_t pos) -> trim_fn_rslt {
+    return trim_while_not_in(s, pos, scan::classes::space);
+};
 
-inline trim_fn_rslt trim_line(const trim_str_like& s, index_t pos) {
-    return *trim_while_false(s, pos, [](int c) -> int { return c == '\n'; }) + 1;
-}
+inline constexpr auto trim_line = []<trim_str_c S>(const S& s, index_t pos) -> trim_fn_rslt {
+    return *trim_while_not_in(s, pos, scan::classes::linebreak) + 1;
+};
 
-inline trim_fn_rslt trim_any_word(const trim_str_like& s, index_t pos) {
-    index_t _pos = *trim_while_false(s, pos, [](int c) -> int { return !std::isalpha(c); });
+inline constexpr auto trim_any_word = []<trim_str_c S>(const S& s, index_t pos) -> trim_fn_rslt {
+    index_t _pos = *trim_while_in(s, pos, scan::classes::alpha);
     if (pos == _pos)
         return std::unexpected(pos);
     return _pos;
-}
+};
 
-inline trim_fn_rslt trim_until_balance(const trim_str_like& s, index_t pos, char inc, char dec, int cnt = 0) {
+inline constexpr auto trim_until_balance = 
+    []<trim_str_c S>(const S& s, index_t pos, char inc, char dec, int cnt = 0) -> trim_fn_rslt {
     bool flag = false;
     while (pos < s.size()) {
         if (!flag && cnt)
@@ -111,100 +218,147 @@ inline trim_fn_rslt trim_until_balance(const trim_str_like& s, index_t pos, char
         ++pos;
     }
     return std::unexpected(pos);
-}
+};
 
 #define trim_until_balance_t(inc, dec, cnt) \
-    [](const tf::trim_str_like& str, tf::index_t pos) { return tf::trim_until_balance(str, pos, inc, dec, cnt); }
+    [](const auto& str, tf::index_t pos) { return tf::trim_until_balance(str, pos, inc, dec, cnt); }
+
+// Same as trim_until_balance from an open bracket, but the close is looked up in an index of the whole text
+inline constexpr auto trim_until_match = 
+    []<trim_str_c S>(const S&, index_t pos, const scan::bracket_index& brackets) -> trim_fn_rslt {
+    index_t close = brackets.match(pos);
+    if (close == scan::bracket_index::npos)
+        return std::unexpected(pos);
+    return close + 1;
+};
+
+// Same as trim_until_match, when there is no index: the close is found from the open bracket at pos on,
+// skipping string literals and closes, that dont match the innermost open bracket, as the index does
+inline constexpr auto trim_until_close = []<trim_str_c S>(const S& s, index_t pos) -> trim_fn_rslt {
+    trims::counted_vector<char> closes;
+    for (index_t i = pos; i < s.size(); ++i) {
+        char c = s[i];
+        if (c == '"' || c == '\'') {
+            // A literal ends at a quote, that isnt escaped, or at a newline
+            for (bool escaped = false; ++i < s.size() && s[i] != '\n'; escaped = !escaped && s[i] == '\\') {
+                if (!escaped && (s[i] == '"' || s[i] == '\''))
+                    break;
+            }
+        } else if (c == '(' || c == '[' || c == '{') {
+            closes.push_back(c == '(' ? ')' : c + 2);
+        } else if (closes.size() && closes.back() == c) {
+            closes.pop_back();
+            if (closes.empty())
+                return i + 1;
+        }
+    }
+    return std::unexpected(pos);
+};
+
+// Moves to a position found beforehand, that isnt behind
+inline constexpr auto trim_to = []<trim_str_c S>(const S& s, index_t pos, index_t to) -> trim_fn_rslt {
+    if (to < pos || to > s.size())
+        return std::unexpected(pos);
+    return to;
+};
 
 namespace program_trims {
 
 inline int is_alph_num(int c) {
-    return std::isalnum(c);
+    return scan::is(c, scan::kinds::alnum);
 }
 inline int is_alpha(int c) {
-    return std::isalpha(c);
+    return scan::is(c, scan::kinds::alpha);
 }
 inline int is_semicolon(int c) {
-    return c == ';';
+    return scan::is(c, scan::kinds::semicolon);
 }
 inline int is_open_brace(int c) {
-    return c == '(' || c == '[';
+    return scan::is(c, scan::kinds::open_brace);
 }
 inline int is_close_brace(int c) {
-    return c == ')';
+    return scan::is(c, scan::kinds::close_brace);
 }
 inline int is_special_open_brace(int c) {
-    return c == '{';
+    return scan::is(c, scan::kinds::special_open_brace);
 }
 inline int is_special_close_brace(int c) {
-    return c == ']' || c == '}';
+    return scan::is(c, scan::kinds::special_close_brace);
 }
 inline int is_linebreak(int c) {
-    return c == '\n';
+    return scan::is(c, scan::kinds::linebreak);
 }
 inline int is_space(int c) {
-    return std::isspace(c);
+    return scan::is(c, scan::kinds::space);
 }
 inline int is_quote(int c) {
-    return c == '\"' || c == '\'';
+    return scan::is(c, scan::kinds::quote);
 }
 inline int is_colon(int c) {
-    return c == ':';
+    return scan::is(c, scan::kinds::colon);
 }
 inline int is_quest_mark(int c) {
-    return c == '?';
+    return scan::is(c, scan::kinds::quest_mark);
 }
 
-inline trim_fn_rslt trim_num_literal(const trim_str_like& s, index_t pos) {
+inline constexpr auto trim_num_literal = []<trim_str_c S>(const S& s, index_t pos) -> trim_fn_rslt {
     if (pos + 2 < s.size() && s.substr(pos, 2) == "0x") {
-        index_t _pos = *trim_while_false(s, pos + 2, [](int c) -> int {
-            return !std::isalnum(c) && (!std::isalpha(c) || c > 'f');
-        });
+        index_t _pos = *trim_while_in(s, pos + 2, scan::classes::alnum);
         if (_pos == pos + 2)
             return std::unexpected(pos);
         return _pos;
     } else {
-        index_t _pos = *trim_while_false(s, pos, [](int c) -> int { return !std::isalnum(c); });
+        index_t _pos = *trim_while_in(s, pos, scan::classes::alnum);
         if (_pos == pos)
             return std::unexpected(pos);
         return _pos;
     }
-}
+};
 
-inline trim_fn_rslt trim_string_literal(const trim_str_like& s, index_t pos) {
+// A quote is escaped by an odd run of backslashes before it, a literal cant span lines
+inline constexpr auto trim_string_literal = []<trim_str_c S>(const S& s, index_t pos) -> trim_fn_rslt {
     index_t _pos = pos;
-    if (s[pos] == '\"' || s[pos] == '\'') {
+    if (pos >= s.size() || !is_quote(s[pos]))
+        return std::unexpected(_pos);
+    bool escaped = false;
+    if constexpr (std::same_as<S, trim_span>) {
+        index_t n = s.end() - ++pos;
+        pos += scan::find_literal_end(s.data(pos), n, escaped);
+        if (pos == s.end()) {
+            if (pos < s.size())
+                s.miss();
+            return std::unexpected(_pos);
+        }
+    } else {
         for (++pos; pos < s.size(); ++pos) {
-            if (s[pos] == '\n')
-                return std::unexpected(pos);
-            if ((s[pos] == '\"' || s[pos] == '\'') && s[pos - 1] != '\\') {
-                if (s[pos] == s[_pos])
-                    return pos + 1;
-                return std::unexpected(_pos);
-            }
+            if (s[pos] == '\n' || (!escaped && is_quote(s[pos])))
+                break;
+            escaped = !escaped && s[pos] == '\\';
         }
+        if (pos == s.size())
+            return std::unexpected(_pos);
     }
+    if (s[pos] == '\n')
+        return std::unexpected(pos);
+    if (s[pos] == s[_pos])
+        return pos + 1;
     return std::unexpected(_pos);
-}
+};
 
-inline trim_fn_rslt trim_token(const trim_str_like& s, index_t pos) {
-    if (pos >= s.size() || std::isalnum(s[pos]))
+inline constexpr auto trim_token = []<trim_str_c S>(const S& s, index_t pos) -> trim_fn_rslt {
+    if (pos >= s.size() || !scan::is(s[pos], scan::kinds::alpha | scan::kinds::underscore))
         return std::unexpected(pos);
-    index_t _pos = *trim_while_false(s, pos, [](int c) -> int {
-        return !std::isalpha(c) && !std::isalnum(c) && c != '_';
-    });
+    index_t _pos = *trim_while_in(s, pos, scan::classes::ident);
     if (pos == _pos)
         return std::unexpected(pos);
     return _pos;
-}
+};
 
-inline trim_fn_rslt trim_operator(const trim_str_like& s, index_t pos) {
-    for (size_t _size = 3; _size; --_size) {
-        if (opr::opr_char(s.substr(pos, _size)))
-            return pos + _size;
-    }
+inline constexpr auto trim_operator = []<trim_str_c S>(const S& s, index_t pos) -> trim_fn_rslt {
+    if (auto match = opr::match_opr(s.substr(pos, opr::opr_trie::max_length)); match.length)
+        return pos + match.length;
     return std::unexpected(pos);
-}
+};
 
 }
 
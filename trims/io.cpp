@@ -1,5 +1,22 @@
 #include "include/io.h"
 
+#if defined(__unix__) || defined(__APPLE__)
+#define IO_POSIX 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <malloc.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <new>
+
 
 namespace io {
 
@@ -16,6 +33,8 @@ std::string get_error_message(error code) {
         return "Failed to get size of a file";
     if (code == error::couldnt_navigate_file)
         return "Failed to navigate a file";
+    if (code == error::couldnt_map_file)
+        return "Failed to map a file to memory";
     return "Undocumented error";
 }
 
@@ -32,6 +51,8 @@ std::string get_error_message(error code, const fs::path& file) {
         return "Failed to get size of " + file.string();
     if (code == error::couldnt_navigate_file)
         return "Failed to navigate, when reading file " + file.string();
+    if (code == error::couldnt_map_file)
+        return "Failed to map file " + file.string() + " to memory";
     return "Undocumented error";
 }
 
@@ -44,6 +65,207 @@ std::expected<std::ifstream, error> open_file_rb(const fs::path& file, bool ate)
     return std::move(in);
 }
 
+#if defined(IO_POSIX)
+
+file_desc& file_desc::operator=(file_desc&& other) noexcept {
+    if (this != &other) {
+        if (_fd != -1)
+            close(_fd);
+        _fd = std::exchange(other._fd, -1);
+    }
+    return *this;
+}
+
+file_desc::~file_desc() {
+    if (_fd != -1)
+        close(_fd);
+}
+
+std::expected<file_desc, error> open_fd_ro(const fs::path& file) noexcept {
+    if (!fs::exists(file))
+        return std::unexpected(error::file_doesnt_exist);
+    int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return std::unexpected(error::couldnt_open_file);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return file_desc(fd);
+}
+
+std::expected<uint64_t, error> get_file_size(const file_desc& fd) noexcept {
+    struct stat st;
+    if (fstat(fd.get(), &st) == -1)
+        return std::unexpected(error::couldnt_get_file_size);
+    return st.st_size;
+}
+
+std::expected<size_t, error> pread_bytes(const file_desc& fd, uint64_t offset, uint8_t* buf, size_t n) noexcept {
+    size_t read_total = 0;
+    while (read_total < n) {
+        ssize_t read = pread(fd.get(), buf + read_total, n - read_total, offset + read_total);
+        if (read == -1 && errno == EINTR)
+            continue;
+        if (read == -1)
+            return std::unexpected(error::couldnt_read_file);
+        if (!read)
+            break;
+        read_total += read;
+    }
+    return read_total;
+}
+
+std::expected<size_t, error> 
+preadv_bytes(const file_desc& fd, uint64_t offset, std::span<const std::span<uint8_t>> bufs) noexcept {
+    constexpr size_t max_batch = 16;
+
+    size_t read_total = 0;
+    iovec iov[max_batch];
+    for (size_t i = 0, skip = 0; i < bufs.size(); ) {
+        size_t n = std::min(bufs.size() - i, max_batch);
+        for (size_t j = 0; j < n; ++j) {
+            size_t off = j ? 0 : skip;
+            iov[j] = { bufs[i + j].data() + off, bufs[i + j].size() - off };
+        }
+        ssize_t read = preadv(fd.get(), iov, n, offset + read_total);
+        if (read == -1 && errno == EINTR)
+            continue;
+        if (read == -1)
+            return std::unexpected(error::couldnt_read_file);
+        if (!read)
+            break;
+        read_total += read;
+        for (size_t left = read + skip; ; ++i) {
+            if (i == bufs.size() || left < bufs[i].size()) {
+                skip = left;
+                break;
+            }
+            left -= bufs[i].size();
+        }
+    }
+    return read_total;
+}
+
+#else
+
+// Without POSIX there are no descriptors to read by position: open_fd_ro fails, so that a stream source is used
+file_desc& file_desc::operator=(file_desc&& other) noexcept {
+    _fd = std::exchange(other._fd, -1);
+    return *this;
+}
+
+file_desc::~file_desc() {}
+
+std::expected<file_desc, error> open_fd_ro(const fs::path& file) noexcept {
+    if (!fs::exists(file))
+        return std::unexpected(error::file_doesnt_exist);
+    return std::unexpected(error::couldnt_open_file);
+}
+
+std::expected<uint64_t, error> get_file_size(const file_desc&) noexcept {
+    return std::unexpected(error::couldnt_get_file_size);
+}
+
+std::expected<size_t, error> pread_bytes(const file_desc&, uint64_t, uint8_t*, size_t) noexcept {
+    return std::unexpected(error::couldnt_read_file);
+}
+
+std::expected<size_t, error> preadv_bytes(const file_desc&, uint64_t, std::span<const std::span<uint8_t>>) noexcept {
+    return std::unexpected(error::couldnt_read_file);
+}
+
+#endif
+
+void aligned_deleter::operator()(uint8_t* buf) const noexcept {
+#if defined(_WIN32)
+    _aligned_free(buf);
+#else
+    std::free(buf);
+#endif
+}
+
+aligned_buffer make_aligned_buffer(size_t n, size_t alignment) noexcept {
+    n = std::max<size_t>(n, 1);
+#if defined(IO_POSIX)
+    void* buf = nullptr;
+    if (posix_memalign(&buf, alignment, n))
+        return aligned_buffer();
+    return aligned_buffer(static_cast<uint8_t*>(buf));
+#elif defined(_WIN32)
+    return aligned_buffer(static_cast<uint8_t*>(_aligned_malloc(n, alignment)));
+#else
+    // aligned_alloc takes sizes, that are multiples of the alignment, only
+    return aligned_buffer(static_cast<uint8_t*>(std::aligned_alloc(alignment, (n + alignment - 1) / alignment * alignment)));
+#endif
+}
+
+namespace {
+
+void unmap(const char* data, [[maybe_unused]] uint64_t size) noexcept {
+    if (!data)
+        return;
+#if defined(IO_POSIX)
+    munmap(const_cast<char*>(data), size);
+#else
+    delete[] data;
+#endif
+}
+
+}
+
+mapped_file& mapped_file::operator=(mapped_file&& other) noexcept {
+    if (this != &other) {
+        unmap(_data, _size);
+        _data = std::exchange(other._data, nullptr), _size = std::exchange(other._size, 0);
+    }
+    return *this;
+}
+
+mapped_file::~mapped_file() {
+    unmap(_data, _size);
+}
+
+#if defined(IO_POSIX)
+
+std::expected<mapped_file, error> map_file_ro(const fs::path& file) noexcept {
+    auto fd = open_fd_ro(file);
+    if (!fd)
+        return std::unexpected(fd.error());
+    auto size = get_file_size(*fd);
+    if (!size)
+        return std::unexpected(size.error());
+    if (!*size)
+        return mapped_file();
+    posix_fadvise(fd->get(), 0, *size, POSIX_FADV_SEQUENTIAL);
+    void* data = mmap(nullptr, *size, PROT_READ, MAP_PRIVATE, fd->get(), 0);
+    if (data == MAP_FAILED)
+        return std::unexpected(error::couldnt_map_file);
+    madvise(data, *size, MADV_SEQUENTIAL);
+    madvise(data, *size, MADV_WILLNEED);
+    return mapped_file(static_cast<const char*>(data), *size);
+}
+
+#else
+
+// Without mmap the file is read into memory through a stream once, the view is the same
+std::expected<mapped_file, error> map_file_ro(const fs::path& file) noexcept {
+    auto in = open_file_rb(file, true);
+    if (!in)
+        return std::unexpected(in.error());
+    auto size = get_file_size(*in, true);
+    if (!size)
+        return std::unexpected(size.error());
+    if (!*size)
+        return mapped_file();
+    char* data = new (std::nothrow) char[*size];
+    if (!data)
+        return std::unexpected(error::couldnt_map_file);
+    mapped_file mapped(data, *size);
+    if (!read_bytes(*in, *size, reinterpret_cast<uint8_t*>(data), *size))
+        return std::unexpected(error::couldnt_read_file);
+    return mapped;
+}
+
+#endif
+
 std::expected<void, io::error> return_to_begin(std::istream& stream) noexcept {
     return_to_begin_unsafe(stream);
     if (!stream.good())
@@ -91,6 +313,20 @@ read_bytes(std::istream& in, uint64_t filesize, uint8_t* buf, size_t max_bytes)
     return read;
 }
 
+std::expected<size_t, error> read_some(std::istream& in, uint8_t* buf, size_t max_bytes) noexcept {
+    if (!max_bytes)
+        return 0;
+    in.read(reinterpret_cast<char*>(buf), 1);
+    if (in.bad())
+        return std::unexpected(error::couldnt_read_file);
+    if (!in.gcount())
+        return 0;
+    size_t n = 1 + in.readsome(reinterpret_cast<char*>(buf) + 1, max_bytes - 1);
+    if (in.bad())
+        return std::unexpected(error::couldnt_read_file);
+    return n;
+}
+
 
 std::expected<std::ofstream, error> open_file_wb(const fs::path& file) noexcept {
     std::ofstream out(file, std::ios_base::binary | std::ios_base::trunc);
@@ -0,0 +1,319 @@
+#include "include/scan.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SCAN_X86_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+
+namespace scan {
+
+void find_newlines(const char* data, size_t n, uint64_t base, std::vector<uint64_t>& out) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i nl = _mm_set1_epi8('\n');
+    for (; i + 16 <= n; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        for (unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, nl)); mask; mask &= mask - 1)
+            out.push_back(base + i + std::countr_zero(mask) + 1);
+    }
+#endif
+    for (; i < n; ++i) {
+        if (data[i] == '\n')
+            out.push_back(base + i + 1);
+    }
+}
+
+namespace {
+
+using find_fn = size_t(*)(const char*, size_t, const char_class&) noexcept;
+
+// Runs shorter than a vector arent worth the table setup
+constexpr size_t min_vector_run = 16;
+
+template<bool In>
+size_t find_scalar(const char* data, size_t n, const char_class& cls) noexcept {
+    for (size_t i = 0; i < n; ++i) {
+        if (cls.test(data[i]) == In)
+            return i;
+    }
+    return n;
+}
+
+#if defined(SCAN_X86_DISPATCH)
+
+// Bytes of a block in cls are where both nibble lookups share a bit, high bytes never match
+template<bool In>
+__attribute__((target("ssse3"))) size_t find_ssse3(const char* data, size_t n, const char_class& cls) noexcept {
+    if (cls.high || n < min_vector_run)
+        return find_scalar<In>(data, n, cls);
+    const __m128i lo_tbl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cls.lo.data()));
+    const __m128i hi_tbl = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i nibble = _mm_set1_epi8(0x0f), zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i lo = _mm_shuffle_epi8(lo_tbl, _mm_and_si128(block, nibble));
+        __m128i hi = _mm_shuffle_epi8(hi_tbl, _mm_and_si128(_mm_srli_epi16(block, 4), nibble));
+        unsigned out = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), zero));
+        if (unsigned mask = In ? ~out & 0xffff : out)
+            return i + std::countr_zero(mask);
+    }
+    return i + find_scalar<In>(data + i, n - i, cls);
+}
+
+template<bool In>
+__attribute__((target("avx2"))) size_t find_avx2(const char* data, size_t n, const char_class& cls) noexcept {
+    if (cls.high || n < min_vector_run)
+        return find_scalar<In>(data, n, cls);
+    const __m256i lo_tbl = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(cls.lo.data())));
+    const __m256i hi_tbl = _mm256_broadcastsi128_si256(
+            _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0));
+    const __m256i nibble = _mm256_set1_epi8(0x0f), zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i lo = _mm256_shuffle_epi8(lo_tbl, _mm256_and_si256(block, nibble));
+        __m256i hi = _mm256_shuffle_epi8(hi_tbl, _mm256_and_si256(_mm256_srli_epi16(block, 4), nibble));
+        uint32_t out = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), zero));
+        if (uint32_t mask = In ? ~out : out)
+            return i + std::countr_zero(mask);
+    }
+    return i + find_ssse3<In>(data + i, n - i, cls);
+}
+
+template<bool In>
+find_fn pick_find() noexcept {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return find_avx2<In>;
+    if (__builtin_cpu_supports("ssse3"))
+        return find_ssse3<In>;
+    return find_scalar<In>;
+}
+
+#else
+
+template<bool In>
+find_fn pick_find() noexcept {
+    return find_scalar<In>;
+}
+
+#endif
+
+}
+
+namespace {
+
+// Quote, backslash and newline bits of a 64-byte block
+struct literal_block {
+    uint64_t backslash, quote, newline;
+};
+
+// Bits of bytes escaped by a preceding odd run of backslashes, as in simdjson: runs starting at even
+// and odd bits are told apart by a carrying add. carry is whether the first byte of the next block is escaped
+inline uint64_t find_escaped(uint64_t backslash, uint64_t& carry) noexcept {
+    constexpr uint64_t even_bits = 0x5555555555555555;
+    backslash &= ~carry;
+    uint64_t follows_escape = backslash << 1 | carry;
+    uint64_t odd_starts = backslash & ~even_bits & ~follows_escape;
+    uint64_t even_starts;
+#if defined(__GNUC__) || defined(__clang__)
+    carry = __builtin_add_overflow(odd_starts, backslash, &even_starts);
+#else
+    even_starts = odd_starts + backslash;
+    carry = even_starts < backslash;
+#endif
+    return (even_bits ^ even_starts << 1) & follows_escape;
+}
+
+inline uint64_t literal_stops(const literal_block& block, uint64_t& carry) noexcept {
+    return (block.quote & ~find_escaped(block.backslash, carry)) | block.newline;
+}
+
+// Tail shorter than a block is classified from a zero padded copy, zeros never stop a literal
+template<class Classify>
+size_t literal_tail(const char* data, size_t n, uint64_t carry, bool& escaped, Classify classify) noexcept {
+    if (!n)
+        return escaped = carry, 0;
+    char block[64] = {};
+    std::memcpy(block, data, n);
+    uint64_t prev = carry;
+    literal_block masks = classify(block);
+    if (uint64_t stops = literal_stops(masks, carry))
+        return std::countr_zero(stops);
+    escaped = find_escaped(masks.backslash, prev) >> n & 1;
+    return n;
+}
+
+#if defined(__SSE2__)
+
+literal_block classify_literal(const char* data) noexcept {
+    const __m128i backslash = _mm_set1_epi8('\\'), dquote = _mm_set1_epi8('"');
+    const __m128i squote = _mm_set1_epi8('\''), nl = _mm_set1_epi8('\n');
+    literal_block masks {};
+    for (int i = 0; i < 4; ++i) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * i));
+        masks.backslash |= uint64_t(_mm_movemask_epi8(_mm_cmpeq_epi8(block, backslash)) & 0xffff) << 16 * i;
+        masks.quote |= uint64_t(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, dquote), 
+                                                               _mm_cmpeq_epi8(block, squote))) & 0xffff) << 16 * i;
+        masks.newline |= uint64_t(_mm_movemask_epi8(_mm_cmpeq_epi8(block, nl)) & 0xffff) << 16 * i;
+    }
+    return masks;
+}
+
+#else
+
+literal_block classify_literal(const char* data) noexcept {
+    literal_block masks {};
+    for (int i = 0; i < 64; ++i) {
+        masks.backslash |= uint64_t(data[i] == '\\') << i;
+        masks.quote |= uint64_t(data[i] == '"' || data[i] == '\'') << i;
+        masks.newline |= uint64_t(data[i] == '\n') << i;
+    }
+    return masks;
+}
+
+#endif
+
+using literal_fn = size_t(*)(const char*, size_t, bool&) noexcept;
+
+size_t find_literal_end_default(const char* data, size_t n, bool& escaped) noexcept {
+    uint64_t carry = escaped;
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        if (uint64_t stops = literal_stops(classify_literal(data + i), carry))
+            return i + std::countr_zero(stops);
+    }
+    return i + literal_tail(data + i, n - i, carry, escaped, classify_literal);
+}
+
+#if defined(SCAN_X86_DISPATCH)
+
+__attribute__((target("avx2"))) literal_block classify_literal_avx2(const char* data) noexcept {
+    const __m256i backslash = _mm256_set1_epi8('\\'), dquote = _mm256_set1_epi8('"');
+    const __m256i squote = _mm256_set1_epi8('\''), nl = _mm256_set1_epi8('\n');
+    literal_block masks {};
+    for (int i = 0; i < 2; ++i) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + 32 * i));
+        masks.backslash |= uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, backslash)))) << 32 * i;
+        masks.quote |= uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(block, dquote), 
+                                                                              _mm256_cmpeq_epi8(block, squote))))) << 32 * i;
+        masks.newline |= uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, nl)))) << 32 * i;
+    }
+    return masks;
+}
+
+__attribute__((target("avx2"))) size_t find_literal_end_avx2(const char* data, size_t n, bool& escaped) noexcept {
+    uint64_t carry = escaped;
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        if (uint64_t stops = literal_stops(classify_literal_avx2(data + i), carry))
+            return i + std::countr_zero(stops);
+    }
+    return i + literal_tail(data + i, n - i, carry, escaped, classify_literal_avx2);
+}
+
+literal_fn pick_literal_end() noexcept {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return find_literal_end_avx2;
+    return find_literal_end_default;
+}
+
+#else
+
+literal_fn pick_literal_end() noexcept {
+    return find_literal_end_default;
+}
+
+#endif
+
+}
+
+namespace {
+
+// Bits of brackets and quotes in data[0, n), n is at most 64
+uint64_t bracket_stops(const char* data, size_t n) noexcept {
+    uint64_t stops = 0;
+    size_t i = 0;
+#if defined(__SSE2__)
+    // '[' ']' differ from '{' '}' only in 0x20, so or-ing it in folds square brackets onto curly ones
+    const __m128i paren = _mm_set1_epi8('('), paren_close = _mm_set1_epi8(')');
+    const __m128i curly = _mm_set1_epi8('{'), curly_close = _mm_set1_epi8('}'), fold = _mm_set1_epi8(0x20);
+    const __m128i dquote = _mm_set1_epi8('"'), squote = _mm_set1_epi8('\'');
+    for (; i + 16 <= n; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i folded = _mm_or_si128(block, fold);
+        __m128i hits = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(block, paren), _mm_cmpeq_epi8(block, paren_close)),
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(folded, curly), _mm_cmpeq_epi8(folded, curly_close)),
+                         _mm_or_si128(_mm_cmpeq_epi8(block, dquote), _mm_cmpeq_epi8(block, squote))));
+        stops |= uint64_t(_mm_movemask_epi8(hits) & 0xffff) << i;
+    }
+#endif
+    constexpr char_class stop_class = char_class::of("()[]{}\"'");
+    for (; i < n; ++i)
+        stops |= uint64_t(stop_class.test(data[i])) << i;
+    return stops;
+}
+
+}
+
+size_t find_literal_end(const char* data, size_t n, bool& escaped) noexcept {
+    static const literal_fn find = pick_literal_end();
+    return find(data, n, escaped);
+}
+
+size_t find_first_of(const char* data, size_t n, const char_class& cls) noexcept {
+    static const find_fn find = pick_find<true>();
+    return find(data, n, cls);
+}
+
+size_t find_first_not_of(const char* data, size_t n, const char_class& cls) noexcept {
+    static const find_fn find = pick_find<false>();
+    return find(data, n, cls);
+}
+
+bracket_index::bracket_index(const char* data, size_t n) : _opens((n + 63) / 64), _ranks(_opens.size()) {
+    trims::counted_vector<std::pair<uint64_t, char>> open;
+    for (size_t base = 0; base < n; ) {
+        size_t len = std::min<size_t>(n - base, 64);
+        uint64_t stops = bracket_stops(data + base, len);
+        size_t next = base + len;
+        while (stops) {
+            size_t i = base + std::countr_zero(stops);
+            stops &= stops - 1;
+            char c = data[i];
+            if (c == '"' || c == '\'') {
+                bool escaped = false;
+                size_t end = i + 1 + find_literal_end(data + i + 1, n - i - 1, escaped);
+                if (end + 1 >= base + len) {
+                    next = end + 1;
+                    break;
+                }
+                stops &= ~uint64_t(0) << (end + 1 - base);
+            } else if (c == '(' || c == '[' || c == '{') {
+                _opens[i >> 6] |= uint64_t(1) << (i & 63);
+                open.emplace_back(_closes.size(), c == '(' ? ')' : c + 2);
+                _closes.push_back(npos);
+            } else if (open.size() && open.back().second == c) {
+                _closes[open.back().first] = i;
+                open.pop_back();
+            }
+        }
+        base = next;
+    }
+    for (size_t word = 1; word < _opens.size(); ++word)
+        _ranks[word] = _ranks[word - 1] + std::popcount(_opens[word - 1]);
+}
+
+}